@@ -0,0 +1,276 @@
+#include "bitmap.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+void bitmap_init(coverage_bitmap *bitmap, size_t bits) {
+	bitmap->bits = bits;
+	bitmap->words.assign((bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS, 0);
+}
+
+size_t bitmap_count(const coverage_bitmap *bitmap) {
+	size_t count = 0;
+	for (uint64_t word : bitmap->words) {
+		count += __builtin_popcountll(word);
+	}
+	return count;
+}
+
+static void compare_words(uint64_t *words, const uint64_t *other, size_t count, bool merge, bitmap_counts *counts) {
+	for (size_t i = 0; i < count; i++) {
+		uint64_t merged = words[i] | other[i];
+		counts->new_bits += __builtin_popcountll(other[i] & ~words[i]);
+		counts->differing += __builtin_popcountll(other[i] ^ words[i]);
+		counts->merged += __builtin_popcountll(merged);
+		if (merge) {
+			words[i] = merged;
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+// Per-byte popcounts from a nibble lookup table, summed into the four 64-bit
+// lanes
+__attribute__((target("avx2")))
+static inline __m256i popcount_lanes(__m256i v) {
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+	__m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_mask));
+	__m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+	return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static uint64_t sum_lanes(__m256i v) {
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *) lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2")))
+static void compare_words_avx2(uint64_t *words, const uint64_t *other, size_t count, bool merge, bitmap_counts *counts) {
+	__m256i new_bits = _mm256_setzero_si256();
+	__m256i differing = _mm256_setzero_si256();
+	__m256i merged = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (words + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (other + i));
+		__m256i either = _mm256_or_si256(a, b);
+
+		new_bits = _mm256_add_epi64(new_bits, popcount_lanes(_mm256_andnot_si256(a, b)));
+		differing = _mm256_add_epi64(differing, popcount_lanes(_mm256_xor_si256(a, b)));
+		merged = _mm256_add_epi64(merged, popcount_lanes(either));
+		if (merge) {
+			_mm256_storeu_si256((__m256i *) (words + i), either);
+		}
+	}
+
+	counts->new_bits += sum_lanes(new_bits);
+	counts->differing += sum_lanes(differing);
+	counts->merged += sum_lanes(merged);
+	compare_words(words + i, other + i, count - i, merge, counts);
+}
+
+#endif
+
+bitmap_counts bitmap_compare(coverage_bitmap *bitmap, const coverage_bitmap *other, bool merge) {
+	bitmap_counts counts = {};
+	size_t count = bitmap->words.size();
+
+#if defined(__x86_64__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		compare_words_avx2(bitmap->words.data(), other->words.data(), count, merge, &counts);
+		return counts;
+	}
+#endif
+
+	compare_words(bitmap->words.data(), other->words.data(), count, merge, &counts);
+	return counts;
+}
+
+static void or_bytes(uint8_t *dst, const uint8_t *src, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		dst[i] |= src[i];
+	}
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static void or_bytes_avx2(uint8_t *dst, const uint8_t *src, size_t size) {
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (src + i));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_or_si256(a, b));
+	}
+	or_bytes(dst + i, src + i, size - i);
+}
+
+#endif
+
+void bitmap_or(void *dst, const void *src, size_t size) {
+#if defined(__x86_64__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		or_bytes_avx2((uint8_t *) dst, (const uint8_t *) src, size);
+		return;
+	}
+#endif
+
+	or_bytes((uint8_t *) dst, (const uint8_t *) src, size);
+}
+
+void hit_map_init(hit_count_map *map, size_t size) {
+	map->size = size;
+	map->bytes.assign((size + HIT_MAP_ALIGN - 1) / HIT_MAP_ALIGN * HIT_MAP_ALIGN, 0);
+}
+
+// The bucket of every count up to 128, later counts share the top bucket
+static const uint8_t *bucket_table() {
+	static uint8_t table[129];
+	static bool filled = [] {
+		table[0] = 0;
+		table[1] = 1;
+		table[2] = 2;
+		table[3] = 4;
+		for (int count = 4; count <= 128; count++) {
+			table[count] = count < 8 ? 8 : count < 16 ? 16 : count < 32 ? 32 : count < 128 ? 64 : 128;
+		}
+		return true;
+	}();
+	(void) filled;
+	return table;
+}
+
+static void classify_counts(uint8_t *bytes, const int64_t *counts, size_t count) {
+	const uint8_t *table = bucket_table();
+
+	// Negative counts are counter overflows, i.e. very many hits
+	for (size_t i = 0; i < count; i++) {
+		uint64_t hits = (uint64_t) counts[i];
+		bytes[i] = table[hits < 128 ? hits : 128];
+	}
+}
+
+#if defined(__x86_64__)
+
+// Counts of 128 and up, negative ones included, all go to the top bucket
+__attribute__((target("avx2")))
+static inline __m256i saturate_counts(__m256i counts) {
+	__m256i small = _mm256_cmpeq_epi64(_mm256_and_si256(counts, _mm256_set1_epi64x(~(int64_t) 127)), _mm256_setzero_si256());
+	return _mm256_blendv_epi8(_mm256_set1_epi64x(128), counts, small);
+}
+
+// 32 counts narrowed to a byte each, at most 128. The packs below interleave
+// their inputs within 128-bit lanes, so counts are loaded in the order that
+// undoes it.
+__attribute__((target("avx2")))
+static inline __m256i narrow_counts(const int64_t *counts) {
+	__m256i dwords[4];
+	for (int group = 0; group < 4; group++) {
+		__m256i low = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (counts + 4 * group)), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i high = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (counts + 16 + 4 * group)), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i even = saturate_counts(_mm256_permute2x128_si256(low, high, 0x20));
+		__m256i odd = saturate_counts(_mm256_permute2x128_si256(low, high, 0x31));
+		dwords[group] = _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+	}
+	return _mm256_packus_epi16(_mm256_packs_epi32(dwords[0], dwords[1]), _mm256_packs_epi32(dwords[2], dwords[3]));
+}
+
+// Bytes of hits that are at least minimum, as unsigned bytes
+__attribute__((target("avx2")))
+static inline __m256i at_least(__m256i hits, uint8_t minimum) {
+	return _mm256_cmpeq_epi8(_mm256_max_epu8(hits, _mm256_set1_epi8((char) minimum)), hits);
+}
+
+__attribute__((target("avx2")))
+static void classify_counts_avx2(uint8_t *bytes, const int64_t *counts, size_t count) {
+	// Buckets of 0 to 15 by the low nibble, larger counts by comparisons
+	const __m256i table = _mm256_setr_epi8(0, 1, 2, 4, 8, 8, 8, 8, 16, 16, 16, 16, 16, 16, 16, 16,
+	                                       0, 1, 2, 4, 8, 8, 8, 8, 16, 16, 16, 16, 16, 16, 16, 16);
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i hits = narrow_counts(counts + i);
+		__m256i buckets = _mm256_shuffle_epi8(table, _mm256_and_si256(hits, _mm256_set1_epi8(0x0f)));
+		buckets = _mm256_blendv_epi8(buckets, _mm256_set1_epi8(32), at_least(hits, 16));
+		buckets = _mm256_blendv_epi8(buckets, _mm256_set1_epi8(64), at_least(hits, 32));
+		buckets = _mm256_blendv_epi8(buckets, _mm256_set1_epi8((char) 128), at_least(hits, 128));
+		_mm256_storeu_si256((__m256i *) (bytes + i), buckets);
+	}
+	classify_counts(bytes + i, counts + i, count - i);
+}
+
+#endif
+
+void hit_map_classify(hit_count_map *map, size_t index, const int64_t *counts, size_t count) {
+	uint8_t *bytes = map->bytes.data() + index;
+
+#if defined(__x86_64__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		classify_counts_avx2(bytes, counts, count);
+		return;
+	}
+#endif
+
+	classify_counts(bytes, counts, count);
+}
+
+static void compare_bytes(uint8_t *bytes, const uint8_t *other, size_t count, bool merge, hit_counts *counts) {
+	for (size_t i = 0; i < count; i++) {
+		counts->new_buckets += (other[i] & ~bytes[i]) != 0;
+		counts->new_arcs += bytes[i] == 0 && other[i] != 0;
+		if (merge) {
+			bytes[i] |= other[i];
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2,popcnt")))
+static void compare_bytes_avx2(uint8_t *bytes, const uint8_t *other, size_t count, bool merge, hit_counts *counts) {
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (size_t i = 0; i < count; i += HIT_MAP_ALIGN) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (bytes + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (other + i));
+
+		// One mask bit per byte that is zero
+		uint32_t no_new = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_andnot_si256(a, b), zero));
+		uint32_t a_zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+		uint32_t b_zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero));
+
+		counts->new_buckets += _mm_popcnt_u32(~no_new);
+		counts->new_arcs += _mm_popcnt_u32(a_zero & ~b_zero);
+		if (merge) {
+			_mm256_storeu_si256((__m256i *) (bytes + i), _mm256_or_si256(a, b));
+		}
+	}
+}
+
+#endif
+
+hit_counts hit_map_compare(hit_count_map *map, const hit_count_map *other, bool merge) {
+	hit_counts counts = {};
+
+#if defined(__x86_64__)
+	static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+	if (avx2) {
+		compare_bytes_avx2(map->bytes.data(), other->bytes.data(), map->bytes.size(), merge, &counts);
+		return counts;
+	}
+#endif
+
+	compare_bytes(map->bytes.data(), other->bytes.data(), map->bytes.size(), merge, &counts);
+	return counts;
+}
@@ -0,0 +1,87 @@
+#ifndef BITMAP_HPP
+#define BITMAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+	Coverage bitmaps, one bit per arc or function, packed into 64-bit words.
+	Bits past the end of the last word are always zero, so the kernels can
+	work on whole words. Comparing and merging two bitmaps is a single pass,
+	with AVX2 when the CPU has it.
+*/
+
+#define BITMAP_WORD_BITS 64
+
+typedef struct {
+	size_t bits;
+	std::vector<uint64_t> words;
+} coverage_bitmap;
+
+// Bit counts from one pass over a bitmap and the one it is compared against
+typedef struct {
+	// Set in the other bitmap only
+	uint64_t new_bits;
+	// Set in exactly one of them
+	uint64_t differing;
+	// Set in either of them
+	uint64_t merged;
+} bitmap_counts;
+
+// Resize to bits, all clear
+void bitmap_init(coverage_bitmap *bitmap, size_t bits);
+
+static inline void bitmap_set(coverage_bitmap *bitmap, size_t bit) {
+	bitmap->words[bit / BITMAP_WORD_BITS] |= (uint64_t) 1 << (bit % BITMAP_WORD_BITS);
+}
+
+static inline bool bitmap_get(const coverage_bitmap *bitmap, size_t bit) {
+	return (bitmap->words[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1;
+}
+
+size_t bitmap_count(const coverage_bitmap *bitmap);
+
+// Count how other differs from bitmap. With merge, bitmap |= other in the
+// same pass. Both must have the same size.
+bitmap_counts bitmap_compare(coverage_bitmap *bitmap, const coverage_bitmap *other, bool merge);
+
+// dst |= src over size bytes, for merging slices of bitmaps and hit count maps
+void bitmap_or(void *dst, const void *src, size_t size);
+
+/*
+	Hit counts, one byte per arc. Like AFL, the count of an arc is reduced to
+	the bucket it falls in (1, 2, 3, 4-7, 8-15, 16-31, 32-127 or 128+), each
+	bucket a bit of the byte. An input is novel if it puts any arc in a bucket
+	no earlier input reached, so a loop running 300 instead of 3 times counts
+	as new behaviour. The map is padded with zero bytes to a whole number of
+	HIT_MAP_ALIGN bytes.
+*/
+
+#define HIT_MAP_ALIGN 32
+
+typedef struct {
+	size_t size;
+	std::vector<uint8_t> bytes;
+} hit_count_map;
+
+// Bit counts from one pass over a hit count map and the one it is compared
+// against
+typedef struct {
+	// Arcs the other map reaches a new bucket on
+	uint64_t new_buckets;
+	// Arcs only the other map hits at all
+	uint64_t new_arcs;
+} hit_counts;
+
+// Resize to size arcs, all unexecuted
+void hit_map_init(hit_count_map *map, size_t size);
+
+// Store the buckets of count counters at index
+void hit_map_classify(hit_count_map *map, size_t index, const int64_t *counts, size_t count);
+
+// Count how other differs from map. With merge, map |= other in the same pass.
+// Both must have the same size.
+hit_counts hit_map_compare(hit_count_map *map, const hit_count_map *other, bool merge);
+
+#endif
@@ -0,0 +1,78 @@
+#include "cmin.hpp"
+
+#include <queue>
+#include <string.h>
+
+void cmin_features(cmin_input *input, const coverage *trace, size_t size, uint32_t exec_us) {
+	input->word_index.clear();
+	input->words.clear();
+	input->cost = (double) (size + 1) * (exec_us + 1);
+
+	const uint8_t *bytes = trace->arc_hits.bytes.data();
+	size_t words = trace->arc_hits.bytes.size() / sizeof(uint64_t);
+	for (size_t i = 0; i < words; i++) {
+		uint64_t word;
+		memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+		if (word) {
+			input->word_index.push_back(i);
+			input->words.push_back(word);
+		}
+	}
+}
+
+// Features of input not in covered yet
+static uint64_t uncovered(const cmin_input *input, const std::vector<uint64_t> &covered) {
+	uint64_t count = 0;
+	for (size_t i = 0; i < input->words.size(); i++) {
+		count += __builtin_popcountll(input->words[i] & ~covered[input->word_index[i]]);
+	}
+	return count;
+}
+
+typedef struct cmin_candidate {
+	double score;
+	size_t input;
+
+	bool operator<(const cmin_candidate &other) const {
+		return score < other.score;
+	}
+} cmin_candidate;
+
+std::vector<size_t> cmin_select(const std::vector<cmin_input> &inputs, size_t feature_words) {
+	std::vector<uint64_t> covered(feature_words, 0);
+	std::vector<size_t> chosen;
+
+	std::priority_queue<cmin_candidate> candidates;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		uint64_t gain = uncovered(&inputs[i], covered);
+		if (gain) {
+			candidates.push({gain / inputs[i].cost, i});
+		}
+	}
+
+	// A score that is still the best once brought up to date wins, as all
+	// the others can only have dropped since they were computed
+	while (!candidates.empty()) {
+		cmin_candidate top = candidates.top();
+		candidates.pop();
+
+		const cmin_input *input = &inputs[top.input];
+		uint64_t gain = uncovered(input, covered);
+		if (!gain) {
+			continue;
+		}
+
+		double score = gain / input->cost;
+		if (!candidates.empty() && score < candidates.top().score) {
+			candidates.push({score, top.input});
+			continue;
+		}
+
+		chosen.push_back(top.input);
+		for (size_t i = 0; i < input->words.size(); i++) {
+			covered[input->word_index[i]] |= input->words[i];
+		}
+	}
+
+	return chosen;
+}
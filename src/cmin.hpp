@@ -0,0 +1,38 @@
+#ifndef CMIN_HPP
+#define CMIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "coverage.hpp"
+
+/*
+	Corpus minimisation. Every input of a corpus is run once, and the subset
+	kept is one that covers all (arc, hit count bucket) pairs the whole corpus
+	covers. Each bit of a hit count map is one such pair, so the map's bytes
+	taken as 64-bit words are the features to cover.
+
+	The subset is a weighted greedy set cover: the input covering the most
+	uncovered features per unit of cost is taken until nothing is left
+	uncovered. The cost of an input is its size times its execution time, as
+	AFL weighs its favoured inputs, so small and fast inputs are preferred.
+	The greedy gains only shrink as features get covered, so they are
+	evaluated lazily from a heap and most inputs are only looked at a few
+	times.
+*/
+
+// An input's features, as the non-zero words of its hit count map
+typedef struct {
+	std::vector<uint32_t> word_index;
+	std::vector<uint64_t> words;
+	double cost;
+} cmin_input;
+
+// Take the features of an execution of an input of size bytes
+void cmin_features(cmin_input *input, const coverage *trace, size_t size, uint32_t exec_us);
+
+// Indices of the inputs making up the cover, in the order they were chosen
+std::vector<size_t> cmin_select(const std::vector<cmin_input> &inputs, size_t feature_words);
+
+#endif
@@ -0,0 +1,117 @@
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const char *map_seed(const corpus_seed *seed) {
+	int fd = open(seed->path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	void *data = mmap(NULL, seed->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	return data == MAP_FAILED ? NULL : (const char *) data;
+}
+
+bool corpus_open(seed_corpus *corpus, std::string directory) {
+	corpus->seeds.clear();
+	corpus->duplicates = 0;
+
+	std::error_code error;
+	std::vector<corpus_seed> files;
+	for (auto &entry : std::filesystem::directory_iterator(directory, error)) {
+		if (!entry.is_regular_file(error)) {
+			continue;
+		}
+		size_t size = entry.file_size(error);
+		if (!error && size > 0) {
+			files.push_back({entry.path(), size, NULL});
+		}
+	}
+	if (error) {
+		printf("Could not list the seeds in %s\n", directory.c_str());
+		return false;
+	}
+
+	// In a stable order, so the first of several copies is the one kept
+	std::sort(files.begin(), files.end(), [](const corpus_seed &a, const corpus_seed &b) {
+		return a.path < b.path;
+	});
+
+	std::map<size_t, size_t> sizes;
+	for (auto &file : files) {
+		sizes[file.size]++;
+	}
+
+	// Seeds kept so far by size and hash of their content
+	std::map<std::pair<size_t, size_t>, std::vector<size_t>> contents;
+	for (auto &file : files) {
+		if (sizes[file.size] > 1) {
+			file.data = map_seed(&file);
+			if (!file.data) {
+				continue;
+			}
+			size_t hash = std::hash<std::string_view>()(std::string_view(file.data, file.size));
+			std::vector<size_t> &same_hash = contents[{file.size, hash}];
+			// Hashes can collide, only the same bytes make a copy
+			bool duplicate = std::any_of(same_hash.begin(), same_hash.end(), [&](size_t index) {
+				return memcmp(corpus->seeds[index].data, file.data, file.size) == 0;
+			});
+			if (duplicate) {
+				munmap((void *) file.data, file.size);
+				corpus->duplicates++;
+				continue;
+			}
+			same_hash.push_back(corpus->seeds.size());
+		}
+		corpus->seeds.push_back(file);
+	}
+
+	return true;
+}
+
+void corpus_close(seed_corpus *corpus) {
+	for (auto &seed : corpus->seeds) {
+		if (seed.data) {
+			munmap((void *) seed.data, seed.size);
+		}
+	}
+	corpus->seeds.clear();
+}
+
+std::string_view corpus_seed_data(seed_corpus *corpus, size_t index) {
+	corpus_seed *seed = &corpus->seeds[index];
+
+	std::lock_guard<std::mutex> lock(corpus->mutex);
+	if (!seed->data) {
+		seed->data = map_seed(seed);
+		if (!seed->data) {
+			return std::string_view();
+		}
+	}
+	return std::string_view(seed->data, seed->size);
+}
+
+void corpus_release(seed_corpus *corpus, size_t index) {
+	corpus_seed *seed = &corpus->seeds[index];
+
+	std::lock_guard<std::mutex> lock(corpus->mutex);
+	if (seed->data) {
+		munmap((void *) seed->data, seed->size);
+		seed->data = NULL;
+	}
+}
+
+std::string_view corpus_pick(seed_corpus *corpus, std::mt19937 &generator) {
+	if (corpus->seeds.empty()) {
+		return std::string_view();
+	}
+	std::uniform_int_distribution<size_t> pick(0, corpus->seeds.size() - 1);
+	return corpus_seed_data(corpus, pick(generator));
+}
@@ -0,0 +1,52 @@
+#ifndef CORPUS_HPP
+#define CORPUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+	The seed corpus: the files in the inputs directory, used as base inputs
+	for the mutation strategies. Seeds can be large and many, so opening the
+	corpus only lists and sizes the files. A seed is mapped the first time it
+	is picked and stays mapped until it is released or the corpus is closed.
+
+	Seeds with the same content are only kept once. Files of different sizes
+	cannot have the same content, so only files sharing their size with
+	another are read (and hashed) when the corpus is opened.
+*/
+
+typedef struct {
+	std::string path;
+	size_t size;
+	// Mapped on first use, NULL until then
+	const char *data;
+} corpus_seed;
+
+typedef struct {
+	std::vector<corpus_seed> seeds;
+	// Files left out as copies of another seed
+	size_t duplicates;
+	// Held while mapping a seed
+	std::mutex mutex;
+} seed_corpus;
+
+// List the non-empty files in directory
+bool corpus_open(seed_corpus *corpus, std::string directory);
+void corpus_close(seed_corpus *corpus);
+
+// The content of seed index, empty if it cannot be read
+std::string_view corpus_seed_data(seed_corpus *corpus, size_t index);
+
+// Unmap seed index again, once nothing uses its data. For passes over the
+// whole corpus, which would otherwise keep every seed mapped.
+void corpus_release(seed_corpus *corpus, size_t index);
+
+// A seed picked uniformly at random
+std::string_view corpus_pick(seed_corpus *corpus, std::mt19937 &generator);
+
+#endif
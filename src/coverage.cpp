@@ -2,136 +2,613 @@
 #include <optional>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <map>
 #include <algorithm>
 #include <filesystem>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 namespace fs = std::filesystem;
 
 #include "coverage.hpp"
 #include "gcov.hpp"
 
-std::optional<coverage> arc_coverage_all_files(std::string directory, bool debug){
-	
-	std::string notes_file_name;
-	std::string count_file_name;
+static size_t word_aligned(size_t bits) {
+	return (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS * BITMAP_WORD_BITS;
+}
+
+// FNV-1a
+#define LAYOUT_HASH_SEED 0xcbf29ce484222325ULL
+
+static uint64_t layout_hash(uint64_t hash, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ ((value >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+	}
+	return hash;
+}
 
-	coverage coverage = {};
+bool load_coverage_model(coverage_model* model, std::string directory, bool debug, bool solve){
+
+	model->directory = directory;
+	model->solve = solve;
+	model->objects.clear();
+	model->arcs = 0;
+	model->functions = 0;
+	model->arc_slots = 0;
+	model->function_slots = 0;
+	model->layout = LAYOUT_HASH_SEED;
 
 	std::vector<std::filesystem::path> dir_files; 
 	
-	for (auto dir_entry : fs::directory_iterator(directory)) {		
-		if (dir_entry.is_regular_file()){
+	// Objects may sit in subdirectories of the SUT, e.g. minisat's core/
+	for (auto dir_entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied)) {		
+		if (dir_entry.is_regular_file() && dir_entry.path().extension() == ".gcno"){
 			dir_files.push_back(dir_entry);
 		}	
 	}
 	std::sort(dir_files.begin(), dir_files.end());
 
-	
 	for(auto dir_file : dir_files){
-		// printf("Dir file: %s\n", dir_file.filename().c_str());
-		
-		if (dir_file.extension() == ".gcda") {
-			count_file_name = dir_file;
-		} 
+		coverage_object object;
+		object.notes_file = dir_file;
+		// Each .gcda is paired with its notes file by stem, at the same path
+		// relative to the directory the counts are read from
+		object.name = dir_file.lexically_relative(directory);
+		object.count_name = fs::path(object.name).replace_extension(".gcda");
+		object.mtime_ns = -1;
+		object.size = -1;
+		object.read_ns = 0;
+		object.arcs_executed = 0;
+		object.functions_executed = 0;
+		object.failed = false;
 
-		if (dir_file.extension() == ".gcno") {
-			notes_file_name = dir_file;
-		} 
+		if (debug)
+			printf("\n------------- Reading notes file %s -------------\n", object.notes_file.c_str());
+
+		if (read_notes_file(object.notes_file, &object.arena, &object.functions, &object.ident_to_fn)) {
+			model->objects.push_back(object);
+			free_coverage_model(model);
+			return false;
+		}
 
-		if(notes_file_name.empty() || count_file_name.empty()){
+		size_t counters = 0;
+		object.layout = LAYOUT_HASH_SEED;
+		for (auto func : object.functions) {
+			counters += func->num_counts;
+			object.layout = layout_hash(object.layout, func->ident);
+			object.layout = layout_hash(object.layout, func->cfg_checksum);
+			object.layout = layout_hash(object.layout, func->num_counts);
+		}
+		object.previous.assign(counters, 0);
+		object.merged.arcs.clear();
+		object.merged.runs = 0;
+
+		object.first_arc = model->arc_slots;
+		object.first_function = model->function_slots;
+		model->arcs += counters;
+		model->functions += object.functions.size();
+		model->arc_slots += word_aligned(counters);
+		model->function_slots += word_aligned(object.functions.size());
+		for (char c : object.name) {
+			model->layout = layout_hash(model->layout, (uint8_t) c);
+		}
+		model->layout = layout_hash(model->layout, object.layout);
+		model->layout = layout_hash(model->layout, object.layout >> 32);
+
+		model->objects.push_back(object);
+	}
+
+	return true;
+}
+
+void merge_count_files(coverage_model* model, std::string count_directory){
+	for (auto &object : model->objects) {
+		std::string count_file_name = fs::path(count_directory) / object.count_name;
+		gcda_counts counts;
+		if (!read_arc_counters(count_file_name, &counts)) {
 			continue;
 		}
 
-		if (debug)
-			printf("\n------------- Reading contents of %s and %s -------------\n", notes_file_name.c_str(), count_file_name.c_str());
-		
-		std::vector<function_info_t*> functions;
-		std::map<uint32_t, function_info_t *> ident_to_fn;
+		// Only what was added since the last merge. A counter that went
+		// down means the file was recreated.
+		gcda_counts added = counts;
+		bool changed = false;
+		for (auto &[ident, counters] : added.arcs) {
+			auto merged = object.merged.arcs.find(ident);
+			for (size_t i = 0; i < counters.size(); i++) {
+				if (merged != object.merged.arcs.end() && merged->second.size() == counters.size() && counters[i] >= merged->second[i]) {
+					counters[i] -= merged->second[i];
+				}
+				changed |= counters[i] != 0;
+			}
+		}
+		added.runs = counts.runs >= object.merged.runs ? counts.runs - object.merged.runs : counts.runs;
 
-		if (debug)
-			printf("Reading notes file... \n");
-		if (read_notes_file(notes_file_name, &functions, &ident_to_fn) ) {
-			return {};
+		if (!changed && !added.runs) {
+			continue;
+		}
+		if (add_arc_counters(fs::path(model->directory) / object.count_name, count_file_name, &added)) {
+			object.merged = counts;
+		} else {
+			printf("Could not add the counters of %s to the SUT's\n", count_file_name.c_str());
+		}
+	}
+}
+
+static void run_coverage_tasks(coverage_pool* pool){
+	size_t index;
+	while ((index = pool->next++) < pool->count) {
+		pool->task(index);
+	}
+}
+
+static void coverage_thread(coverage_pool* pool){
+	uint64_t generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			pool->wake.wait(lock, [&] { return pool->stop || pool->generation != generation; });
+			if (pool->stop) {
+				return;
+			}
+			generation = pool->generation;
+		}
+
+		run_coverage_tasks(pool);
+
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		if (--pool->active == 0) {
+			pool->finished.notify_all();
+		}
+	}
+}
+
+void start_coverage_threads(coverage_model* model, size_t threads){
+	coverage_pool* pool = &model->pool;
+	pool->generation = 0;
+	pool->stop = false;
+	pool->active = 0;
+
+	// One object per thread at most, counting the caller's
+	threads = std::min(threads, model->objects.size() > 0 ? model->objects.size() - 1 : 0);
+	for (size_t i = 0; i < threads; i++) {
+		pool->threads.emplace_back(coverage_thread, pool);
+	}
+}
+
+// Run task on every index below count, spread over the pool's threads and
+// the caller
+static void run_on_pool(coverage_pool* pool, size_t count, std::function<void(size_t)> task){
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->task = task;
+		pool->next = 0;
+		pool->count = count;
+		pool->active = pool->threads.size();
+		pool->generation++;
+	}
+	pool->wake.notify_all();
+
+	run_coverage_tasks(pool);
+
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	pool->finished.wait(lock, [&] { return pool->active == 0; });
+}
+
+void free_coverage_model(coverage_model* model){
+	{
+		std::lock_guard<std::mutex> lock(model->pool.mutex);
+		model->pool.stop = true;
+	}
+	model->pool.wake.notify_all();
+	for (auto &thread : model->pool.threads) {
+		thread.join();
+	}
+	model->pool.threads.clear();
+
+	for (auto &object : model->objects) {
+		arena_free(&object.arena);
+	}
+	model->objects.clear();
+	model->arcs = 0;
+	model->functions = 0;
+}
+
+static int64_t timespec_ns(struct timespec time) {
+	return (int64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// Whether the .gcda may have been written since the object was last read.
+// File times come from a coarse clock, so a write in the same tick as the
+// last read does not show in the mtime.
+static bool count_file_changed(coverage_object* object, std::string count_file_name) {
+	struct stat st;
+	if (stat(count_file_name.c_str(), &st) != 0) {
+		return false;
+	}
+
+	int64_t mtime_ns = timespec_ns(st.st_mtim);
+	bool changed = mtime_ns != object->mtime_ns || st.st_size != object->size
+		|| mtime_ns >= object->read_ns - MTIME_SLACK_MS * 1000000;
+
+	object->mtime_ns = mtime_ns;
+	object->size = st.st_size;
+	return changed;
+}
+
+// Read one object's counters into its slices of the coverage bitmaps
+static void read_object(coverage_model* model, coverage_object* object, const fs::path &count_dir, coverage* coverage, bool debug){
+	std::string count_file_name = count_dir / object->count_name;
+
+	object->arcs_executed = 0;
+	object->functions_executed = 0;
+	object->failed = false;
+
+	// Nothing ran in an object whose .gcda is unchanged, or that has none
+	// yet
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (!count_file_changed(object, count_file_name)) {
+		return;
+	}
+	object->read_ns = timespec_ns(now);
+
+	// The counters accumulate in read_count_file
+	for (auto func : object->functions) {
+		std::fill(func->counts, func->counts + func->num_counts, 0);
+	}
+
+	if (debug)
+		printf("\nReading count file %s... \n", count_file_name.c_str());
+	if (read_count_file(count_file_name, &object->ident_to_fn)) {
+		printf("Error when reading count file\n");
+		object->failed = true;
+		return;
+	}
+
+	// The .gcda counters accumulate over every run. Keep only what changed
+	// since the last read, so the graph is that of the runs in between. A
+	// counter that went down means the file was recreated.
+	size_t index = 0;
+	for (auto func : object->functions) {
+		for (uint32_t i = 0; i < func->num_counts; i++) {
+			int64_t total = func->counts[i];
+			func->counts[i] = total >= object->previous[index] ? total - object->previous[index] : total;
+			object->previous[index++] = total;
+		}
+	}
+
+	if (model->solve) {
+		for (auto it = object->functions.begin(); it != object->functions.end(); it++) {
+			solve_flow_graph(*it, object->notes_file);
+		}
+	}
+
+	size_t first_arc = object->first_arc;
+	size_t function_index = object->first_function;
+	for (auto it = object->functions.begin(); it != object->functions.end(); it++, function_index++) {
+		function_info_t* func = *it;
+
+		if (debug){
+			printf("\nFunction name: %s\n", func->m_name);
+			printf("Number of blocks: %u\n", func->num_blocks);
+		}
+
+		uint32_t arcs_executed = 0;
+		hit_map_classify(&coverage->arc_hits, first_arc, func->counts, func->num_counts);
+		for (size_t i = 0; i < func->num_counts; i++) {
+			if (func->counts[i] > 0) {
+				arcs_executed += 1;
+				bitmap_set(&coverage->arc_coverage, first_arc + i);
+			}
+		}
+
+		if (arcs_executed > 1){
+			bitmap_set(&coverage->function_coverage, function_index);
+			object->functions_executed += 1;
 		}
 
 		if (debug)
-			printf("\nReading count file... \n");
-		if (read_count_file(count_file_name, &ident_to_fn)) {
-			printf("Error when reading count file\n");
+			printf("Arcs executed: %i/%u\n", arcs_executed, func->num_counts);
+
+		object->arcs_executed += arcs_executed;
+		first_arc += func->num_counts;
+	}
+
+	if (debug)
+		printf("Function arcs executed: %i/%lu\n", object->arcs_executed, object->previous.size());
+}
+
+void init_coverage(coverage_model* model, coverage* coverage){
+	*coverage = {};
+	bitmap_init(&coverage->arc_coverage, model->arc_slots);
+	hit_map_init(&coverage->arc_hits, model->arc_slots);
+	bitmap_init(&coverage->function_coverage, model->function_slots);
+	coverage->arcs = model->arcs;
+	coverage->functions = model->functions;
+}
+
+std::optional<coverage> read_coverage(coverage_model* model, bool debug, std::string count_directory){
+
+	coverage coverage;
+	init_coverage(model, &coverage);
+
+	fs::path count_dir = count_directory.empty() ? model->directory : count_directory;
+
+	// Every object writes to its own words of the bitmaps only
+	auto task = [&](size_t index) {
+		read_object(model, &model->objects[index], count_dir, &coverage, debug);
+	};
+	if (debug || model->pool.threads.empty()) {
+		for (size_t i = 0; i < model->objects.size(); i++) {
+			task(i);
+		}
+	} else {
+		run_on_pool(&model->pool, model->objects.size(), task);
+	}
+
+	for (auto &object : model->objects) {
+		if (object.failed) {
 			return {};
 		}
+		coverage.arcs_executed += object.arcs_executed;
+		coverage.functions_executed += object.functions_executed;
+	}
+
+	return coverage;
+}
+
+/*
+	A coverage map file holds, after a header of magic, version and object
+	count (all uint32), for every object:
+		uint32:name_length char*:name uint64:layout
+		uint32:functions {uint32:ident uint32:cfg_checksum uint32:counters}*
+		uint64*:arc_bits uint8*:arc_hits uint64*:function_bits
+	The bitmaps are the object's slices, with as many words as its arcs and
+	functions need, and one hit count byte per arc. Values are in host byte
+	order, a map from a host of the other order fails the magic check.
+*/
+
+static uint32_t object_counters(const coverage_object* object) {
+	uint32_t counters = 0;
+	for (auto func : object->functions) {
+		counters += func->num_counts;
+	}
+	return counters;
+}
+
+static size_t words_for(size_t bits) {
+	return word_aligned(bits) / BITMAP_WORD_BITS;
+}
+
+template <typename T>
+static void write_value(FILE* file, T value) {
+	fwrite(&value, sizeof(T), 1, file);
+}
 
-		for (auto it = functions.begin(); it != functions.end(); it++) {
-			solve_flow_graph(*it, notes_file_name);
+bool save_coverage_map(coverage_model* model, coverage* coverage, std::string file_name){
+	if (coverage->arc_coverage.bits != model->arc_slots || coverage->function_coverage.bits != model->function_slots) {
+		printf("Coverage does not match the notes it is saved with.\n");
+		return false;
+	}
+
+	// Written aside and renamed, so an interrupted save keeps the old map
+	std::string temp_name = file_name + ".tmp";
+	FILE* file = fopen(temp_name.c_str(), "wb");
+	if (!file) {
+		printf("Could not write coverage map %s\n", temp_name.c_str());
+		return false;
+	}
+
+	write_value<uint32_t>(file, COVERAGE_MAP_MAGIC);
+	write_value<uint32_t>(file, COVERAGE_MAP_VERSION);
+	write_value<uint32_t>(file, model->objects.size());
+
+	for (auto &object : model->objects) {
+		uint32_t counters = object_counters(&object);
+
+		write_value<uint32_t>(file, object.name.size());
+		fwrite(object.name.data(), 1, object.name.size(), file);
+		write_value<uint64_t>(file, object.layout);
+		write_value<uint32_t>(file, object.functions.size());
+		for (auto func : object.functions) {
+			write_value<uint32_t>(file, func->ident);
+			write_value<uint32_t>(file, func->cfg_checksum);
+			write_value<uint32_t>(file, func->num_counts);
 		}
 
-		uint32_t function_arc_count = 0;
-		uint32_t function_arcs_executed = 0;
-		for (auto it = functions.begin(); it != functions.end(); it++) {
-			function_info_t* func = *it;
-			auto blocks = func->blocks;
+		fwrite(&coverage->arc_coverage.words[object.first_arc / BITMAP_WORD_BITS], sizeof(uint64_t), words_for(counters), file);
+		fwrite(&coverage->arc_hits.bytes[object.first_arc], 1, counters, file);
+		fwrite(&coverage->function_coverage.words[object.first_function / BITMAP_WORD_BITS], sizeof(uint64_t), words_for(object.functions.size()), file);
+	}
 
-			if (debug){
-				printf("\nFunction name: %s\n", func->m_name.c_str());
-				printf("Number of blocks: %lu\n", func->blocks.size());
-			}
+	bool written = !ferror(file);
+	written = fclose(file) == 0 && written;
+	if (!written || rename(temp_name.c_str(), file_name.c_str()) != 0) {
+		printf("Could not write coverage map %s\n", file_name.c_str());
+		remove(temp_name.c_str());
+		return false;
+	}
+	return true;
+}
 
-			for (auto bit = blocks.begin(); bit != blocks.end(); bit++) {
-				block_info block = *bit;
-				// printf("Block id: %u, counnt : %lu, is_return: %u, is_call: %u\n", block.id, block.count, block.is_call_return, block.is_call_site);
-			}
+typedef struct {
+	std::vector<uint8_t> data;
+	size_t pos;
+	bool error;
+} map_reader;
 
-			std::vector<int64_t> arc_counts = func->counts;
-			uint32_t arcs_executed = 0;
-			for(auto count : arc_counts){
-				if (count > 0) {
-					arcs_executed += 1;
-					coverage.arc_coverage.push_back(true);
-				} else {
-					coverage.arc_coverage.push_back(false);
+// A pointer to the next size bytes of the map, or NULL past its end
+static const uint8_t* read_bytes(map_reader* reader, size_t size) {
+	if (reader->error || reader->data.size() - reader->pos < size) {
+		reader->error = true;
+		return NULL;
+	}
+	const uint8_t* bytes = reader->data.data() + reader->pos;
+	reader->pos += size;
+	return bytes;
+}
+
+template <typename T>
+static T read_value(map_reader* reader) {
+	T value = 0;
+	const uint8_t* bytes = read_bytes(reader, sizeof(T));
+	if (bytes) {
+		memcpy(&value, bytes, sizeof(T));
+	}
+	return value;
+}
+
+typedef struct {
+	uint32_t ident;
+	uint32_t cfg_checksum;
+	uint32_t counters;
+} map_function;
+
+// Merge the saved arcs of an object whose layout differs, function by function
+static void merge_functions(coverage_object* object, coverage* coverage, const std::vector<map_function> &saved, const uint64_t* arc_bits, const uint8_t* arc_hits, const uint64_t* function_bits) {
+	std::map<uint32_t, size_t> saved_index;
+	std::vector<size_t> saved_first(saved.size());
+	size_t first = 0;
+	for (size_t i = 0; i < saved.size(); i++) {
+		saved_index[saved[i].ident] = i;
+		saved_first[i] = first;
+		first += saved[i].counters;
+	}
+
+	size_t first_arc = object->first_arc;
+	for (size_t f = 0; f < object->functions.size(); f++) {
+		function_info_t* func = object->functions[f];
+		auto it = saved_index.find(func->ident);
+		if (it != saved_index.end()) {
+			const map_function &match = saved[it->second];
+			if (match.cfg_checksum == func->cfg_checksum && match.counters == func->num_counts) {
+				for (size_t arc = 0; arc < func->num_counts; arc++) {
+					size_t bit = saved_first[it->second] + arc;
+					if ((arc_bits[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1) {
+						bitmap_set(&coverage->arc_coverage, first_arc + arc);
+					}
+					coverage->arc_hits.bytes[first_arc + arc] |= arc_hits[bit];
+				}
+				if ((function_bits[it->second / BITMAP_WORD_BITS] >> (it->second % BITMAP_WORD_BITS)) & 1) {
+					bitmap_set(&coverage->function_coverage, object->first_function + f);
 				}
 			}
+		}
+		first_arc += func->num_counts;
+	}
+}
 
-			coverage.functions += 1;
-			if (arcs_executed > 1){
-				coverage.functions_executed += 1;
-				coverage.function_coverage.push_back(true);
-			} else {
-				coverage.function_coverage.push_back(false);
-			}
+bool load_coverage_map(coverage_model* model, coverage* coverage, std::string file_name){
+	if (coverage->arc_coverage.bits != model->arc_slots || coverage->function_coverage.bits != model->function_slots) {
+		printf("Coverage does not match the notes the map is loaded with.\n");
+		return false;
+	}
+
+	map_reader reader = {};
+	FILE* file = fopen(file_name.c_str(), "rb");
+	if (!file) {
+		printf("Could not open coverage map %s\n", file_name.c_str());
+		return false;
+	}
+	uint8_t buffer[65536];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		reader.data.insert(reader.data.end(), buffer, buffer + got);
+	}
+	fclose(file);
+
+	if (read_value<uint32_t>(&reader) != COVERAGE_MAP_MAGIC || read_value<uint32_t>(&reader) != COVERAGE_MAP_VERSION) {
+		printf("%s is not a coverage map of this version\n", file_name.c_str());
+		return false;
+	}
+
+	std::map<std::string, coverage_object*> objects;
+	for (auto &object : model->objects) {
+		objects[object.name] = &object;
+	}
 
-			if (debug)
-				printf("Arcs executed: %i/%lu\n", arcs_executed, arc_counts.size());
+	// Check the whole map before merging any of it
+	std::vector<size_t> starts;
+	uint32_t object_count = read_value<uint32_t>(&reader);
+	for (uint32_t i = 0; i < object_count && !reader.error; i++) {
+		starts.push_back(reader.pos);
+		uint32_t name_length = read_value<uint32_t>(&reader);
+		read_bytes(&reader, name_length);
+		read_value<uint64_t>(&reader);
+		uint32_t function_count = read_value<uint32_t>(&reader);
+		size_t counters = 0;
+		for (uint32_t f = 0; f < function_count && !reader.error; f++) {
+			read_value<uint32_t>(&reader);
+			read_value<uint32_t>(&reader);
+			counters += read_value<uint32_t>(&reader);
+		}
+		read_bytes(&reader, words_for(counters) * sizeof(uint64_t) + counters + words_for(function_count) * sizeof(uint64_t));
+	}
+	if (reader.error || reader.pos != reader.data.size()) {
+		printf("Corrupted coverage map %s\n", file_name.c_str());
+		return false;
+	}
 
-			function_arcs_executed += arcs_executed;
-			function_arc_count += arc_counts.size();
+	for (size_t start : starts) {
+		reader.pos = start;
+		uint32_t name_length = read_value<uint32_t>(&reader);
+		std::string name((const char*) read_bytes(&reader, name_length), name_length);
+		uint64_t layout = read_value<uint64_t>(&reader);
+
+		std::vector<map_function> functions(read_value<uint32_t>(&reader));
+		size_t counters = 0;
+		for (auto &function : functions) {
+			function.ident = read_value<uint32_t>(&reader);
+			function.cfg_checksum = read_value<uint32_t>(&reader);
+			function.counters = read_value<uint32_t>(&reader);
+			counters += function.counters;
 		}
 
-		if (debug)
-			printf("Function arcs executed: %i/%i\n", function_arcs_executed, function_arc_count);
-		
-		coverage.arcs_executed += function_arcs_executed;
-		coverage.arcs += function_arc_count;
+		// The bitmaps are copied out, the slices are not word aligned in the file
+		std::vector<uint64_t> arc_bits(words_for(counters));
+		std::vector<uint64_t> function_bits(words_for(functions.size()));
+		memcpy(arc_bits.data(), read_bytes(&reader, arc_bits.size() * sizeof(uint64_t)), arc_bits.size() * sizeof(uint64_t));
+		const uint8_t* arc_hits = read_bytes(&reader, counters);
+		memcpy(function_bits.data(), read_bytes(&reader, function_bits.size() * sizeof(uint64_t)), function_bits.size() * sizeof(uint64_t));
 
-		for (auto func : functions) {		
-			for (auto arc : func->arcs){
-				delete arc;
-			}
-			delete func;
+		auto it = objects.find(name);
+		if (it == objects.end()) {
+			continue;
 		}
+		coverage_object* object = it->second;
+
+		if (layout == object->layout && functions.size() == object->functions.size() && counters == object_counters(object)) {
+			bitmap_or(&coverage->arc_coverage.words[object->first_arc / BITMAP_WORD_BITS], arc_bits.data(), arc_bits.size() * sizeof(uint64_t));
+			bitmap_or(&coverage->arc_hits.bytes[object->first_arc], arc_hits, counters);
+			bitmap_or(&coverage->function_coverage.words[object->first_function / BITMAP_WORD_BITS], function_bits.data(), function_bits.size() * sizeof(uint64_t));
+		} else {
+			merge_functions(object, coverage, functions, arc_bits.data(), arc_hits, function_bits.data());
+		}
+	}
 
-		notes_file_name.clear();
-		count_file_name.clear();
+	coverage->arcs_executed = bitmap_count(&coverage->arc_coverage);
+	coverage->functions_executed = bitmap_count(&coverage->function_coverage);
+	return true;
+}
+
+std::optional<coverage> arc_coverage_all_files(std::string directory, bool debug, std::string count_directory){
+	coverage_model model;
+	if (!load_coverage_model(&model, directory, debug, true)) {
+		return {};
 	}
 
+	std::optional<coverage> coverage = read_coverage(&model, debug, count_directory);
+	free_coverage_model(&model);
 	return coverage;
 }
 
 std::optional<coverage_diff> calc_coverage_diff(coverage* prev, coverage* cur){
 	
-	if (prev->arc_coverage.size() != cur->arc_coverage.size()){
+	if (prev->arc_coverage.bits != cur->arc_coverage.bits){
 		return {};
-	} else if (prev->function_coverage.size() != cur->function_coverage.size()) {
+	} else if (prev->function_coverage.bits != cur->function_coverage.bits) {
 		return {};
 	}
 	
@@ -140,47 +617,58 @@ std::optional<coverage_diff> calc_coverage_diff(coverage* prev, coverage* cur){
 	diff.arcs_executed_change = cur->arcs_executed - prev->arcs_executed;
 	diff.functions_executed_change = cur->functions_executed - prev->functions_executed;
 	
-	for (size_t i = 0; i < prev->arc_coverage.size(); i++) {
-    	if (prev->arc_coverage[i] == false && cur->arc_coverage[i] == true){
-			diff.new_unique_arcs_executed++;
-		} else if (prev->arc_coverage[i] == cur->arc_coverage[i]){
-			diff.arcs_executed_overlap++;
-		}
-    }
+	bitmap_counts arcs = bitmap_compare(&prev->arc_coverage, &cur->arc_coverage, false);
+	diff.new_unique_arcs_executed = arcs.new_bits;
+	diff.new_hit_buckets = hit_map_compare(&prev->arc_hits, &cur->arc_hits, false).new_buckets;
+	diff.arcs_executed_overlap = prev->arcs - arcs.differing;
+
+	bitmap_counts functions = bitmap_compare(&prev->function_coverage, &cur->function_coverage, false);
+	diff.new_unique_funcs_executed = functions.new_bits;
+	diff.funcs_executed_overlap = prev->functions - functions.differing;
 
-	for (size_t i = 0; i < prev->function_coverage.size(); i++) {
-    	if (prev->function_coverage[i] == false && cur->function_coverage[i] == true){
-			diff.new_unique_funcs_executed++;
-		} else if (prev->function_coverage[i] == cur->function_coverage[i]){
-			diff.funcs_executed_overlap++;
-		}
-    }
 	return diff;
 }
 
 
 std::optional<coverage*> calc_aggregrate_coverage(coverage* aggregate, coverage* cur){
 	
-	if (aggregate->arc_coverage.size() != cur->arc_coverage.size() || aggregate->function_coverage.size() != cur->function_coverage.size()){
+	if (aggregate->arc_coverage.bits != cur->arc_coverage.bits || aggregate->function_coverage.bits != cur->function_coverage.bits){
 		printf("Aggregation failed: The current coverage and aggregate coverage do not have matching dimensions.");
 		return {};
 	}
 		
-	for (size_t i = 0; i < aggregate->arc_coverage.size(); i++) {
-    	if (aggregate->arc_coverage[i] == false && cur->arc_coverage[i] == true){
-			aggregate->arcs_executed++;
-		}
-		aggregate->arc_coverage[i] = cur->arc_coverage[i] | aggregate->arc_coverage[i];
+	aggregate->arcs_executed = bitmap_compare(&aggregate->arc_coverage, &cur->arc_coverage, true).merged;
+	hit_map_compare(&aggregate->arc_hits, &cur->arc_hits, true);
+	aggregate->functions_executed = bitmap_compare(&aggregate->function_coverage, &cur->function_coverage, true).merged;
+
+	return aggregate;
+}
+
+
+std::optional<coverage_diff> merge_coverage(coverage* aggregate, coverage* cur){
+
+	if (aggregate->arc_coverage.bits != cur->arc_coverage.bits || aggregate->function_coverage.bits != cur->function_coverage.bits){
+		printf("Aggregation failed: The current coverage and aggregate coverage do not have matching dimensions.");
+		return {};
 	}
 
-	for (size_t i = 0; i < aggregate->function_coverage.size(); i++) {
-    	if (aggregate->function_coverage[i] == false && cur->function_coverage[i] == true){
-			aggregate->functions_executed++;
-		}
-		aggregate->function_coverage[i] = cur->function_coverage[i] | aggregate->function_coverage[i];
-    }
+	coverage_diff diff = {};
 
-	return aggregate;
+	diff.arcs_executed_change = cur->arcs_executed - aggregate->arcs_executed;
+	diff.functions_executed_change = cur->functions_executed - aggregate->functions_executed;
+
+	bitmap_counts arcs = bitmap_compare(&aggregate->arc_coverage, &cur->arc_coverage, true);
+	diff.new_unique_arcs_executed = arcs.new_bits;
+	diff.new_hit_buckets = hit_map_compare(&aggregate->arc_hits, &cur->arc_hits, true).new_buckets;
+	diff.arcs_executed_overlap = aggregate->arcs - arcs.differing;
+	aggregate->arcs_executed = arcs.merged;
+
+	bitmap_counts functions = bitmap_compare(&aggregate->function_coverage, &cur->function_coverage, true);
+	diff.new_unique_funcs_executed = functions.new_bits;
+	diff.funcs_executed_overlap = aggregate->functions - functions.differing;
+	aggregate->functions_executed = functions.merged;
+
+	return diff;
 }
 
 
@@ -1,26 +1,40 @@
 #ifndef COVERAGE_HPP
 #define COVERAGE_HPP
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 #include <stdint.h>
 
+#include "bitmap.hpp"
+#include "gcov.hpp"
+
+
 typedef struct {
 	uint32_t arcs;
 	uint32_t arcs_executed;
-	std::vector<bool> arc_coverage;
+	coverage_bitmap arc_coverage;
+	// Hit count bucket of every arc
+	hit_count_map arc_hits;
 
 	uint32_t functions;
 	uint32_t functions_executed;
-	std::vector<bool> function_coverage;
+	coverage_bitmap function_coverage;
 } coverage;
 
 typedef struct {
 	int32_t arcs_executed_change;
 	uint32_t arcs_executed_overlap;
 	uint32_t new_unique_arcs_executed;
+	// Arcs in a hit count bucket not seen before, including new arcs
+	uint32_t new_hit_buckets;
 	
 	int32_t functions_executed_change;
 	uint32_t funcs_executed_overlap;
@@ -28,9 +42,128 @@ typedef struct {
 } coverage_diff;
 
 
+// A .gcda whose mtime is this close to its last read is read again anyway,
+// as file times only advance with the kernel's coarse clock
+#define MTIME_SLACK_MS 20
+
+// The flow graph of one object file, from its .gcno
+typedef struct {
+	std::string notes_file;
+	// Path of the .gcno relative to the model's directory, which names the
+	// object in coverage maps
+	std::string name;
+	// Hash of the identity of its functions and their counter counts. Objects
+	// of the same name and layout have the same arcs in the same order.
+	uint64_t layout;
+	// Name of its .gcda, relative to the directory the counts are read from
+	std::string count_name;
+
+	// Owns the graphs of all its functions
+	gcov_arena arena;
+	std::vector<function_info_t*> functions;
+	std::map<uint32_t, function_info_t *> ident_to_fn;
+
+	// Counters of the last read, in function order
+	std::vector<int64_t> previous;
+	// Counters of a count directory's .gcda already added to the object's
+	// own, see merge_count_files
+	gcda_counts merged;
+
+	// Where the object's arcs and functions start in the coverage bitmaps.
+	// Both are word aligned, so objects can be read in parallel.
+	size_t first_arc;
+	size_t first_function;
+
+	// Results of the last read_coverage
+	uint32_t arcs_executed;
+	uint32_t functions_executed;
+	bool failed;
+
+	// The .gcda as of the last read, which is skipped while they stay the same
+	int64_t mtime_ns;
+	int64_t size;
+	int64_t read_ns;
+} coverage_object;
+
+// Threads reading the objects of one coverage_model. The thread calling
+// read_coverage works on them as well.
+typedef struct {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	// Bumped for every read, and set stop, to wake the threads
+	uint64_t generation;
+	bool stop;
+	// Threads still working on the current read
+	size_t active;
+
+	std::function<void(size_t)> task;
+	std::atomic<size_t> next;
+	size_t count;
+} coverage_pool;
+
+// The notes of every object under a directory. They do not change during a
+// campaign, so they are read once and only the .gcda counters are read per
+// execution.
+typedef struct {
+	std::string directory;
+	std::vector<coverage_object> objects;
+	size_t arcs;
+	size_t functions;
+	// Bitmap sizes, with every object's slice padded to a whole word
+	size_t arc_slots;
+	size_t function_slots;
+	// Hash of the names and layouts of all objects
+	uint64_t layout;
+
+	coverage_pool pool;
+
+	// Propagate the counters through the flow graphs on every read. Coverage
+	// only needs the raw arc counters, so this is for reporting.
+	bool solve;
+} coverage_model;
+
+bool load_coverage_model(coverage_model* model, std::string directory, bool debug, bool solve = false);
+void free_coverage_model(coverage_model* model);
+// Read the objects on this many threads besides the caller
+void start_coverage_threads(coverage_model* model, size_t threads);
+// Coverage of the runs since the previous read. count_directory overrides
+// where the .gcda files are read from (defaults to the directory of the .gcno
+// files).
+std::optional<coverage> read_coverage(coverage_model* model, bool debug, std::string count_directory = "");
+// Add the counters written to count_directory since the last call to the
+// .gcda files of the model's directory, where gcov reads them from. Runs
+// with a GCOV_PREFIX otherwise never show up there.
+void merge_count_files(coverage_model* model, std::string count_directory);
+// Empty coverage laid out like the model's
+void init_coverage(coverage_model* model, coverage* coverage);
+
+/*
+	Coverage maps on disk. Bit positions in a coverage depend on the order the
+	objects and functions are read in, so a map keys every arc by its stable
+	identity instead: the object's .gcno path, the function's ident and
+	cfg_checksum, and the arc's index among the function's counters. Maps of
+	other campaigns or machines can be merged as long as they were built from
+	the same sources. Arcs of functions whose flow graph changed since are
+	dropped.
+*/
+
+#define COVERAGE_MAP_MAGIC 0x667a636d // fzcm
+#define COVERAGE_MAP_VERSION 1
+
+bool save_coverage_map(coverage_model* model, coverage* coverage, std::string file_name);
+// OR the map in file_name into coverage, laid out by model
+bool load_coverage_map(coverage_model* model, coverage* coverage, std::string file_name);
+
 std::optional<coverage*> calc_aggregrate_coverage(coverage* aggregate, coverage* cur);
 std::optional<coverage_diff> calc_coverage_diff(coverage* prev, coverage* cur);
-std::optional<coverage> arc_coverage_all_files(std::string directory, bool debug);
+// calc_coverage_diff against the aggregate, merging cur into it in the same pass
+std::optional<coverage_diff> merge_coverage(coverage* aggregate, coverage* cur);
+// Load the notes, read the counts with the graphs solved and free the notes
+// again
+std::optional<coverage> arc_coverage_all_files(std::string directory, bool debug, std::string count_directory = "");
 void print_coverage_info(coverage* coverage);
 
 #endif
@@ -0,0 +1,143 @@
+#include "elf.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+	const unsigned char *data;
+	size_t size;
+} elf_file;
+
+static bool elf_open(std::string path, elf_file *file) {
+	file->data = NULL;
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Elf64_Ehdr)) {
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	file->data = (const unsigned char *) data;
+	file->size = info.st_size;
+
+	const Elf64_Ehdr *header = (const Elf64_Ehdr *) file->data;
+	if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    header->e_shentsize != sizeof(Elf64_Shdr) ||
+	    header->e_shoff + (size_t) header->e_shnum * sizeof(Elf64_Shdr) > file->size) {
+		munmap((void *) file->data, file->size);
+		file->data = NULL;
+		return false;
+	}
+	return true;
+}
+
+static void elf_close(elf_file *file) {
+	if (file->data) {
+		munmap((void *) file->data, file->size);
+	}
+}
+
+// Section index, NULL if it is out of the file
+static const Elf64_Shdr *elf_section(const elf_file *file, size_t index) {
+	const Elf64_Ehdr *header = (const Elf64_Ehdr *) file->data;
+	if (index >= header->e_shnum) {
+		return NULL;
+	}
+	const Elf64_Shdr *section = (const Elf64_Shdr *) (file->data + header->e_shoff) + index;
+	if (section->sh_type != SHT_NOBITS && section->sh_offset + section->sh_size > file->size) {
+		return NULL;
+	}
+	return section;
+}
+
+// A string of a string table section, "" if it is out of the table
+static std::string elf_string(const elf_file *file, const Elf64_Shdr *strings, size_t offset) {
+	if (!strings || offset >= strings->sh_size) {
+		return "";
+	}
+	const char *start = (const char *) file->data + strings->sh_offset + offset;
+	return std::string(start, strnlen(start, strings->sh_size - offset));
+}
+
+bool elf_read_dynamic(std::string path, elf_dynamic *dynamic) {
+	dynamic->needed.clear();
+	dynamic->runpath.clear();
+
+	elf_file file;
+	if (!elf_open(path, &file)) {
+		return false;
+	}
+
+	std::string origin = std::filesystem::path(path).parent_path().string();
+	const Elf64_Ehdr *header = (const Elf64_Ehdr *) file.data;
+	for (size_t i = 0; i < header->e_shnum; i++) {
+		const Elf64_Shdr *section = elf_section(&file, i);
+		if (!section || section->sh_type != SHT_DYNAMIC) {
+			continue;
+		}
+
+		const Elf64_Shdr *strings = elf_section(&file, section->sh_link);
+		const Elf64_Dyn *entries = (const Elf64_Dyn *) (file.data + section->sh_offset);
+		for (size_t j = 0; j < section->sh_size / sizeof(Elf64_Dyn) && entries[j].d_tag != DT_NULL; j++) {
+			std::string value = elf_string(&file, strings, entries[j].d_un.d_val);
+			if (entries[j].d_tag == DT_NEEDED) {
+				dynamic->needed.push_back(value);
+			} else if (entries[j].d_tag == DT_RUNPATH || entries[j].d_tag == DT_RPATH) {
+				size_t start = 0;
+				while (start <= value.size()) {
+					size_t end = std::min(value.find(':', start), value.size());
+					std::string directory = value.substr(start, end - start);
+					for (size_t at; (at = directory.find("$ORIGIN")) != std::string::npos;) {
+						directory.replace(at, strlen("$ORIGIN"), origin);
+					}
+					if (!directory.empty()) {
+						dynamic->runpath.push_back(directory);
+					}
+					start = end + 1;
+				}
+			}
+		}
+	}
+
+	elf_close(&file);
+	return true;
+}
+
+bool elf_has_symbol(std::string path, const std::vector<std::string> &names) {
+	elf_file file;
+	if (!elf_open(path, &file)) {
+		return false;
+	}
+
+	bool found = false;
+	const Elf64_Ehdr *header = (const Elf64_Ehdr *) file.data;
+	for (size_t i = 0; i < header->e_shnum && !found; i++) {
+		const Elf64_Shdr *section = elf_section(&file, i);
+		if (!section || (section->sh_type != SHT_SYMTAB && section->sh_type != SHT_DYNSYM)) {
+			continue;
+		}
+
+		const Elf64_Shdr *strings = elf_section(&file, section->sh_link);
+		const Elf64_Sym *symbols = (const Elf64_Sym *) (file.data + section->sh_offset);
+		for (size_t j = 0; j < section->sh_size / sizeof(Elf64_Sym) && !found; j++) {
+			std::string name = elf_string(&file, strings, symbols[j].st_name);
+			found = std::find(names.begin(), names.end(), name) != names.end();
+		}
+	}
+
+	elf_close(&file);
+	return found;
+}
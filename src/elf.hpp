@@ -0,0 +1,27 @@
+#ifndef ELF_HPP
+#define ELF_HPP
+
+#include <string>
+#include <vector>
+
+/*
+	Just enough of an ELF reader to tell how the SUT binary was built, which
+	runtime libraries it loads, without running it.
+*/
+
+typedef struct {
+	// Sonames of the DT_NEEDED entries
+	std::vector<std::string> needed;
+	// DT_RUNPATH or DT_RPATH directories, $ORIGIN already replaced
+	std::vector<std::string> runpath;
+} elf_dynamic;
+
+// Read the dynamic section of a 64-bit ELF file. A statically linked binary
+// has an empty one. Returns false if path is not a readable ELF file.
+bool elf_read_dynamic(std::string path, elf_dynamic *dynamic);
+
+// Whether .symtab or .dynsym of a 64-bit ELF file names one of the symbols,
+// defined or not.
+bool elf_has_symbol(std::string path, const std::vector<std::string> &names);
+
+#endif
@@ -0,0 +1,265 @@
+#include "forkserver.hpp"
+#include "forkserver_protocol.h"
+#include "elf.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FORKSERVER_LIBRARY "fuzz-forkserver.so"
+#define FORKSERVER_START_TIMEOUT_MS 5000
+
+// The server is installed next to the fuzz-sat executable.
+static std::string preload_library_path() {
+	std::error_code error;
+	std::filesystem::path exe = std::filesystem::read_symlink("/proc/self/exe", error);
+	if (error) {
+		return "";
+	}
+	return (exe.parent_path() / FORKSERVER_LIBRARY).string();
+}
+
+// ASan refuses to start unless its runtime is the first library loaded, so it
+// has to precede the server in LD_PRELOAD. Only the runtime the solver itself
+// links is preloaded: a solver with ASan linked in statically, or without
+// ASan, must not get a second one.
+static std::string asan_runtime_path(std::string sut_binary) {
+	if (const char *path = getenv("FUZZ_ASAN_RUNTIME")) {
+		return path;
+	}
+
+	elf_dynamic dynamic;
+	if (sut_binary.empty() || !elf_read_dynamic(sut_binary, &dynamic)) {
+		return "";
+	}
+	for (const std::string &needed : dynamic.needed) {
+		if (needed.find("libasan") == std::string::npos) {
+			continue;
+		}
+		// LD_PRELOAD searches the default paths for a bare soname, but not
+		// the solver's own runpath
+		for (const std::string &directory : dynamic.runpath) {
+			std::string path = directory + "/" + needed;
+			if (access(path.c_str(), R_OK) == 0) {
+				return path;
+			}
+		}
+		return needed;
+	}
+	return "";
+}
+
+// Returns 1 once a word was read, 0 on timeout and -1 if the server is gone.
+static int read_word(int fd, int32_t *word, int timeout_ms) {
+	struct pollfd poll_fd = {fd, POLLIN, 0};
+
+	int res;
+	do {
+		res = poll(&poll_fd, 1, timeout_ms);
+	} while (res < 0 && errno == EINTR);
+
+	if (res == 0) {
+		return 0;
+	} else if (res < 0) {
+		return -1;
+	}
+
+	return read(fd, word, sizeof(*word)) == sizeof(*word) ? 1 : -1;
+}
+
+bool forkserver_start(Forkserver *server, const std::vector<std::string> &args, std::string sut_binary, std::string server_dir, const std::vector<std::string> &environment, const TestCase *testcase, const ResourceLimits *limits) {
+	server->running = false;
+
+	std::string library = preload_library_path();
+	if (library.empty() || access(library.c_str(), R_OK) != 0) {
+		printf("Fork server library %s not found, executing the SUT directly.\n", library.c_str());
+		return false;
+	}
+
+	std::string preload = library;
+	std::string asan_runtime = asan_runtime_path(sut_binary);
+	if (!asan_runtime.empty()) {
+		preload = asan_runtime + " " + library;
+	}
+
+	// When started through runsat.sh, the shell and the helpers it runs carry
+	// the solver's ASan runtime too. The environment's ASAN_OPTIONS (from
+	// runsat.sh) keeps them from reporting leaks on exit.
+	std::vector<std::string> server_environment;
+	for (const std::string &entry : environment) {
+		if (entry.rfind("LD_PRELOAD=", 0) == 0)
+			continue;
+		server_environment.push_back(entry);
+	}
+	server_environment.push_back("LD_PRELOAD=" + preload);
+	server_environment.push_back(std::string(FORKSERVER_DIR_ENV) + "=" + std::filesystem::canonical(server_dir).string());
+
+	// The server and its children share the cgroup and file size limit. The
+	// server's CPU time adds up over the campaign, and the solver's shadow
+	// memory is only mapped once it runs, so the server applies those two
+	// to every child itself.
+	ResourceLimits server_limits = *limits;
+	server_limits.cpu_seconds = 0;
+	server_limits.address_space = false;
+	if (limits->memory_mb > 0 && limits->cgroup.empty()) {
+		server_environment.push_back(std::string(FORKSERVER_MEMORY_LIMIT_ENV) + "=" + std::to_string(limits->memory_mb));
+	}
+	if (limits->cpu_seconds > 0) {
+		server_environment.push_back(std::string(FORKSERVER_CPU_LIMIT_ENV) + "=" + std::to_string(limits->cpu_seconds));
+	}
+
+	std::vector<char*> envp;
+	for (const std::string &entry : server_environment)
+		envp.push_back((char*) entry.c_str());
+	envp.push_back(NULL);
+
+	std::vector<char*> argv;
+	for (const std::string &arg : args)
+		argv.push_back((char*) arg.c_str());
+	argv.push_back(NULL);
+
+	// Close-on-exec, so that SUTs started concurrently by other workers do
+	// not hold on to this server's pipes.
+	int control[2];
+	int status[2];
+	int output[2];
+	if (pipe2(control, O_CLOEXEC)) {
+		return false;
+	}
+	if (pipe2(status, O_CLOEXEC)) {
+		close(control[0]);
+		close(control[1]);
+		return false;
+	}
+	if (pipe2(output, O_CLOEXEC)) {
+		close(control[0]);
+		close(control[1]);
+		close(status[0]);
+		close(status[1]);
+		return false;
+	}
+
+	// A write to a server that died must not take the fuzzer down with it.
+	signal(SIGPIPE, SIG_IGN);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		setpgid(0, 0);
+		dup2(control[0], FORKSERVER_CONTROL_FD);
+		dup2(status[1], FORKSERVER_STATUS_FD);
+		dup2(output[1], STDOUT_FILENO);
+		dup2(output[1], STDERR_FILENO);
+		dup2(testcase->fd, SUT_INPUT_FD);
+		limits_apply(&server_limits);
+
+		execve(argv[0], argv.data(), envp.data());
+		_exit(1);
+	}
+
+	close(control[0]);
+	close(status[1]);
+	close(output[1]);
+
+	server->pid = pid;
+	server->control_fd = control[1];
+	server->status_fd = status[0];
+	server->output_fd = output[0];
+
+	if (pid == -1) {
+		close(server->control_fd);
+		close(server->status_fd);
+		close(server->output_fd);
+		return false;
+	}
+
+	// Drained between the status words, so a full pipe never blocks the child
+	fcntl(server->output_fd, F_SETFL, O_NONBLOCK);
+
+	server->running = true;
+
+	int32_t hello;
+	if (read_word(server->status_fd, &hello, FORKSERVER_START_TIMEOUT_MS) != 1 || hello != FORKSERVER_HELLO) {
+		printf("Fork server did not start, executing the SUT directly.\n");
+		forkserver_stop(server);
+		return false;
+	}
+
+	return true;
+}
+
+int forkserver_run(Forkserver *server, std::chrono::milliseconds timeout, bool *timed_out, OutputBuffer *output) {
+	*timed_out = false;
+	output_clear(output);
+
+	uint32_t command = 1;
+	if (write(server->control_fd, &command, sizeof(command)) != sizeof(command)) {
+		return -1;
+	}
+
+	int32_t child_pid;
+	if (read_word(server->status_fd, &child_pid, -1) != 1) {
+		return -1;
+	}
+
+	Deadline deadline;
+	deadline_start(&deadline, child_pid, timeout);
+
+	// Collect the output until the server reports the child's status
+	int32_t status;
+	while (true) {
+		struct pollfd poll_fds[2] = {
+			{server->status_fd, POLLIN, 0},
+			{server->output_fd, POLLIN, 0},
+		};
+
+		int res = poll(poll_fds, 2, deadline_wait_ms(&deadline));
+		if (res < 0 && errno != EINTR) {
+			return -1;
+		}
+
+		if (res > 0 && (poll_fds[1].revents & POLLIN)) {
+			output_drain(server->output_fd, output);
+		}
+
+		if (res > 0 && (poll_fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+			if (read(server->status_fd, &status, sizeof(status)) != sizeof(status)) {
+				return -1;
+			}
+			break;
+		}
+
+		// Only a child that is still running can run out of time
+		if (deadline_expire(&deadline)) {
+			*timed_out = true;
+		}
+	}
+
+	// The child is gone, whatever it wrote is in the pipe
+	output_drain(server->output_fd, output);
+	output_finish(output);
+
+	return status;
+}
+
+void forkserver_stop(Forkserver *server) {
+	if (!server->running) {
+		return;
+	}
+
+	close(server->control_fd);
+	close(server->status_fd);
+	close(server->output_fd);
+
+	// The server and anything started before it share one process group.
+	kill(-server->pid, SIGKILL);
+	waitpid(server->pid, NULL, 0);
+
+	server->running = false;
+}
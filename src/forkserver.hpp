@@ -0,0 +1,46 @@
+#ifndef FORKSERVER_HPP
+#define FORKSERVER_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "launch.hpp"
+
+/*
+	Client side of the fork server (see forkserver_preload.c). The SUT is
+	started once with the server preloaded into the solver, after which every
+	execution is a fork() of the already loaded, already initialised solver
+	instead of a shell, a bash script and a cold sanitizer start.
+*/
+
+typedef struct {
+	bool running;
+
+	// The shell running runsat.sh
+	pid_t pid;
+
+	int control_fd;
+	int status_fd;
+
+	// Read end of the pipe every child writes its stdout and stderr to
+	int output_fd;
+} Forkserver;
+
+// Start the SUT (runsat.sh through a shell, or the solver itself) with the
+// fork server preloaded. Only an executable inside server_dir becomes the
+// server. Every child reads the test case on SUT_INPUT_FD and runs under
+// limits. Returns false (and leaves the server stopped) if the solver never
+// checks in, in which case the caller should fall back to executing the SUT
+// normally. sut_binary is the solver args end up running, empty if unknown.
+bool forkserver_start(Forkserver *server, const std::vector<std::string> &args, std::string sut_binary, std::string server_dir, const std::vector<std::string> &environment, const TestCase *testcase, const ResourceLimits *limits);
+
+// Run the solver once and capture what it printed in output. Returns the
+// solver's wait status, or -1 if the server died. The child's process group
+// is killed once timeout expires.
+int forkserver_run(Forkserver *server, std::chrono::milliseconds timeout, bool *timed_out, OutputBuffer *output);
+
+void forkserver_stop(Forkserver *server);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+	Fork server preloaded into the SUT through LD_PRELOAD (see forkserver.hpp).
+
+	runsat.sh and the tools it starts inherit the preload too, so the server
+	only activates in an executable that lives inside FUZZ_FORKSERVER_DIR.
+	It then stops the solver in a constructor, before the solver's own
+	constructors and main have run, and forks a fresh child every time the
+	fuzzer asks for one. The child returns from the constructor and runs the
+	solver as usual, so gcov and the sanitizers behave exactly as they would
+	for a freshly exec'd process.
+
+	Protocol, in 32-bit words:
+		server -> fuzzer: FORKSERVER_HELLO once started
+		fuzzer -> server: any word to run the solver once
+		server -> fuzzer: child pid (and process group), then its wait status
+*/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "forkserver_protocol.h"
+
+// Size of the address space mapped so far, in bytes
+static rlim_t mapped_size(void) {
+	char statm[64];
+	int fd = open("/proc/self/statm", O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	ssize_t length = read(fd, statm, sizeof(statm) - 1);
+	close(fd);
+	if (length <= 0) {
+		return 0;
+	}
+	statm[length] = '\0';
+
+	return (rlim_t) strtoull(statm, NULL, 10) * sysconf(_SC_PAGESIZE);
+}
+
+static rlim_t limit_from_env(const char *name) {
+	const char *value = getenv(name);
+	return value != NULL ? strtoull(value, NULL, 10) : 0;
+}
+
+static void set_limit(int resource, rlim_t soft, rlim_t hard) {
+	struct rlimit limit = {soft, hard};
+	setrlimit(resource, &limit);
+}
+
+__attribute__((constructor)) static void forkserver_init(void) {
+	const char *dir = getenv(FORKSERVER_DIR_ENV);
+	if (dir == NULL) {
+		return;
+	}
+
+	char exe[PATH_MAX];
+	ssize_t exe_length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (exe_length <= 0) {
+		return;
+	}
+	exe[exe_length] = '\0';
+
+	size_t dir_length = strlen(dir);
+	if (strncmp(exe, dir, dir_length) != 0 || exe[dir_length] != '/') {
+		return;
+	}
+
+	// An RLIMIT_AS from exec time would not leave room for the sanitizer's
+	// shadow, but by now it is mapped and the limit can go on top of it.
+	rlim_t memory_limit = limit_from_env(FORKSERVER_MEMORY_LIMIT_ENV) << 20;
+	if (memory_limit > 0) {
+		memory_limit += mapped_size();
+	}
+	rlim_t cpu_limit = limit_from_env(FORKSERVER_CPU_LIMIT_ENV);
+
+	// Not started by the fuzzer (or the fuzzer went away), run normally.
+	uint32_t hello = FORKSERVER_HELLO;
+	if (write(FORKSERVER_STATUS_FD, &hello, sizeof(hello)) != sizeof(hello)) {
+		return;
+	}
+
+	while (1) {
+		uint32_t command;
+		if (read(FORKSERVER_CONTROL_FD, &command, sizeof(command)) != sizeof(command)) {
+			_exit(0);
+		}
+
+		pid_t child = fork();
+		if (child < 0) {
+			_exit(1);
+		}
+
+		// Each child leads a process group of its own, which the fuzzer
+		// kills as a whole on a timeout. Both sides set it, so that it
+		// exists by the time the fuzzer learns the pid.
+		if (child == 0) {
+			setpgid(0, 0);
+			close(FORKSERVER_CONTROL_FD);
+			close(FORKSERVER_STATUS_FD);
+
+			// CPU time starts from zero in every child
+			if (memory_limit > 0) {
+				set_limit(RLIMIT_AS, memory_limit, memory_limit);
+			}
+			if (cpu_limit > 0) {
+				set_limit(RLIMIT_CPU, cpu_limit, cpu_limit + 1);
+			}
+			return;
+		}
+
+		setpgid(child, child);
+
+		int32_t child_pid = child;
+		if (write(FORKSERVER_STATUS_FD, &child_pid, sizeof(child_pid)) != sizeof(child_pid)) {
+			_exit(0);
+		}
+
+		int status;
+		if (waitpid(child, &status, 0) < 0) {
+			_exit(1);
+		}
+
+		int32_t child_status = status;
+		if (write(FORKSERVER_STATUS_FD, &child_status, sizeof(child_status)) != sizeof(child_status)) {
+			_exit(0);
+		}
+	}
+}
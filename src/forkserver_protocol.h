@@ -0,0 +1,21 @@
+#ifndef FORKSERVER_PROTOCOL_H
+#define FORKSERVER_PROTOCOL_H
+
+// Shared between the fuzzer and the preloaded fork server, which is plain C.
+
+// File descriptors the fork server talks to the fuzzer on.
+#define FORKSERVER_CONTROL_FD 198
+#define FORKSERVER_STATUS_FD 199
+
+// First word written by the fork server once it is up.
+#define FORKSERVER_HELLO 0x46525652
+
+// Canonical SUT directory, only executables inside it become fork servers.
+#define FORKSERVER_DIR_ENV "FUZZ_FORKSERVER_DIR"
+
+// Limits the server applies to every child. The memory limit is on top of
+// the address space the server already has mapped, sanitizer shadow included.
+#define FORKSERVER_MEMORY_LIMIT_ENV "FUZZ_FORKSERVER_MEMORY_LIMIT_MB"
+#define FORKSERVER_CPU_LIMIT_ENV "FUZZ_FORKSERVER_CPU_LIMIT_S"
+
+#endif
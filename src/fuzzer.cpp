@@ -1,22 +1,33 @@
 #include "fuzzer.hpp"
 #include "coverage.hpp"
 #include "generate.hpp"
+#include "cmin.hpp"
+#include "tmin.hpp"
 
 #define FUZZER_TIMEOUT 1800
-#define SUT_TIMEOUT 5
+#define SUT_TIMEOUT 5 // Full limit, see timeout.hpp
 
 #define FIFO_SIZE 5
 
+#define STATS_INTERVAL 5
+
 #define GEN_MAX 100.0
 #define MUT_MAX 3.0
 
 #define GEN_START 0.6
 #define MUT_START 0.6
 
+// Generation aggressiveness a strategy keeps after its input hit a resource limit
+#define RESOURCE_BACKOFF 0.75
+
 
-std::string FILENAME = "current-test.cnf";
 int counter = 0;
 bool verbose = false;
+bool use_forkserver = true;
+size_t output_cap = DEFAULT_OUTPUT_CAP;
+size_t memory_limit_mb = DEFAULT_MEMORY_LIMIT_MB;
+int cpu_limit_s = DEFAULT_CPU_LIMIT_S;
+size_t file_size_limit_mb = DEFAULT_FILE_SIZE_LIMIT_MB;
 
 std::string exec(const char *cmd)
 {
@@ -35,48 +46,44 @@ std::string exec(const char *cmd)
 }
 
 
-int interruptible_system(const char *cmd) {
-  if (cmd == NULL){
-    return 1;
+// Environment for the SUT, with the worker's gcov redirection applied. Built
+// once per worker, as only async-signal-safe calls may follow a fork() in a
+// multi-threaded process.
+std::vector<std::string> build_environment(const Worker *worker, const Campaign *campaign) {
+  std::vector<std::string> environment;
+
+  for (char **var = environ; *var != NULL; var++) {
+    std::string entry = *var;
+    if (entry.rfind("GCOV_PREFIX=", 0) == 0 || entry.rfind("GCOV_PREFIX_STRIP=", 0) == 0)
+      continue;
+    environment.push_back(entry);
   }
 
-  pid_t pid = fork();
-
-  if (pid == -1){
-    // Could not fork.
-    return -1;
-  } else if (pid == 0){
-    // This is the child. Run the command.
-    int exec_res = execl("/bin/sh", "sh", "-c", cmd, (char*) NULL);
-    if (exec_res){
-      exit(1);
-    } else {
-      exit(0);
-    }
-  
-  } else {
-    // Wait for all children to finish.
-    int child_res;
-    int wait_res = waitpid(-1, &child_res, 0);
-    if (wait_res){
-      return wait_res;
-    } else {
-      return child_res;
-    }
+  if (!worker->gcov_prefix.empty()) {
+    environment.push_back("GCOV_PREFIX=" + worker->gcov_prefix);
+    environment.push_back("GCOV_PREFIX_STRIP=" + std::to_string(worker->gcov_prefix_strip));
   }
+
+  // The sanitizer options runsat.sh would have set
+  apply_environment(&environment, campaign->sut_exports);
+  limits_environment(&worker->limits, &environment);
+
+  return environment;
 }
 
 void initialise_saved_inputs(Input *saved) { 
   for (int i = 0; i < 20; i++) {
     saved[i].type = placeholder;
     saved[i].priority = 0;
-    saved[i].hash = get_hash("empty");
+    saved[i].hash = 0;
   }
 }
 
-bool evaluate_input(Input *saved, undefined_behaviour_t type, std::size_t hash) {
+bool evaluate_input(Input *saved, signature_set *seen, const std::string &input, undefined_behaviour_t type, uint64_t hash) {
   bool new_type = true;
-  bool new_hash = true;
+  // Over the whole campaign, so a bug is not new again once its input was
+  // replaced in the saved list
+  bool new_hash = signature_set_insert(seen, hash);
 
   int type_representation [ub_end] = {0};
 
@@ -86,10 +93,6 @@ bool evaluate_input(Input *saved, undefined_behaviour_t type, std::size_t hash)
     if (saved[i].type == type) {
       new_type = false;
     }
-    
-    if (saved[i].hash == hash) {
-      new_hash = false;
-    }
   }
 
   int priority = 0;  
@@ -97,6 +100,9 @@ bool evaluate_input(Input *saved, undefined_behaviour_t type, std::size_t hash)
   // Calculate priority from seen/unseen type or address
   if (type == no_error || type == uncategorized) {
     priority = 0;
+  } else if (type == oom || type == cpu_exceeded) {
+    // Worth keeping only until real bugs fill the list
+    priority = 1;
   } else if (type == error) {
     priority = 2;  
   } else if (new_type && new_hash) {
@@ -125,9 +131,9 @@ bool evaluate_input(Input *saved, undefined_behaviour_t type, std::size_t hash)
   if (min_priority != 99 && priority > min_priority) {
     std::cout << "Replacing input " << std::to_string(min_index) << " with new input: Priority: " << std::to_string(priority) << ", Type: " << std::to_string(type) << std::endl;
     
-    std::string mv = "mv " + FILENAME + " fuzzed-tests/saved" + std::to_string(min_index) + ".cnf";
+    // The test case only exists in memory, write it out
+    create_file("fuzzed-tests/saved" + std::to_string(min_index) + ".cnf", input);
     counter++;
-    std::system(mv.c_str());
 
     // Remove lowest priority from the list, append current input 
     saved[min_index].priority = priority;
@@ -142,50 +148,166 @@ bool evaluate_input(Input *saved, undefined_behaviour_t type, std::size_t hash)
   return false;
 }
 
-bool run_solver(std::string path_to_SUT, Input *saved, std::string input)
+// The command running the SUT on the worker's test case
+std::vector<std::string> sut_command(Worker *worker, Campaign *campaign)
 {
-    if (verbose) std::cout << "-----------------------------------------------------------------" << std::endl;
+    if (campaign->direct)
+      return {campaign->sut_binary, worker->testcase.path};
 
-    create_file(FILENAME, input);
-    // Read input file
-    std::ifstream input_stream(FILENAME);
-    std::string input_content((std::istreambuf_iterator<char>(input_stream)),
-                              std::istreambuf_iterator<char>());
-    // if (verbose) print_file(input_content, "INPUT");
-
-    std::string run_solver = path_to_SUT + "/runsat.sh " + FILENAME;
-
-    // Redirect SUT output to file
-    std::string output_file = "output.txt";
-    std::string redirect_output = run_solver + " > " + output_file + " 2>&1";
-    interruptible_system(redirect_output.c_str());
-
-    // Read output file
-    std::ifstream output_stream(output_file);
-    std::string output_content((std::istreambuf_iterator<char>(output_stream)),
-                               std::istreambuf_iterator<char>());
-    if (verbose) print_file(output_content, "OUTPUT");
-    
-    undefined_behaviour_t error_type = process_output(output_content);
-    std::size_t hash = get_hash(output_content);
-        
-    return evaluate_input(saved, error_type, hash);
+    return {"/bin/sh", "-c", campaign->path_to_SUT + "/runsat.sh " + worker->testcase.path};
+}
+
+// Run the SUT once on the worker's test case, leaving its wait status in
+// status. Returns false if it timed out.
+bool execute_testcase(Worker *worker, Campaign *campaign, std::chrono::milliseconds timeout, int *status)
+{
+    bool timed_out = false;
+    if (worker->forkserver.running)
+    {
+      *status = forkserver_run(&worker->forkserver, timeout, &timed_out, &worker->output);
+      if (*status == -1)
+      {
+        std::cout << "Fork server died, executing the SUT directly." << std::endl;
+        forkserver_stop(&worker->forkserver);
+        *status = interruptible_exec(sut_command(worker, campaign), worker->environment, &worker->testcase, &worker->limits, &worker->output, timeout, &timed_out);
+      }
+    }
+    else
+    {
+      // SUT output is captured over a pipe into the worker's buffer, the SUT's
+      // process group is killed once the timeout expires
+      *status = interruptible_exec(sut_command(worker, campaign), worker->environment, &worker->testcase, &worker->limits, &worker->output, timeout, &timed_out);
+    }
+    campaign->execs++;
+
+    return !timed_out;
 }
 
-bool run_solver_with_timeout(std::string path_to_SUT, Input *saved, std::string input, std::chrono::seconds timeout)
+// Executor stage: run the SUT on one generated input. Inputs that time out
+// are re-run at the full limit before they count as hangs.
+void run_solver(Worker *worker, Campaign *campaign, GeneratedInput *generated, ExecResult *result)
 {
-    std::future<bool> solver_future = std::async(std::launch::async, run_solver, path_to_SUT, saved, input);
+    testcase_write(&worker->testcase, generated->input);
+
+    std::chrono::milliseconds timeout = timeout_for(&campaign->timeouts, generated->gen_strat);
+    auto start = std::chrono::steady_clock::now();
+    bool finished = execute_testcase(worker, campaign, timeout, &result->status);
+
+    // Only an input that also times out at the full limit is a hang
+    if (!finished && timeout < campaign->timeouts.limit)
+    {
+      if (verbose) std::cout << "Solver timed out after " << timeout.count() << " ms, re-running at the full limit." << std::endl;
+      start = std::chrono::steady_clock::now();
+      finished = execute_testcase(worker, campaign, campaign->timeouts.limit, &result->status);
+    }
+
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    result->exec_us = time.count();
+    if (finished)
+    {
+      if (timeouts_record(&campaign->timeouts, generated->gen_strat, time) && verbose)
+        std::cout << "Timeout for generation strategy " << generated->gen_strat << ": " << timeout_for(&campaign->timeouts, generated->gen_strat).count() << " ms" << std::endl;
+    }
+
+    // Read before the next execution adds to the counters, so that the
+    // trace is this input's alone
+    result->trace = read_coverage(&worker->notes, false, worker->count_dir);
+
+    result->input = std::move(generated->input);
+    result->gen_strat = generated->gen_strat;
+    result->depth = generated->depth;
+    result->finished = finished;
+    result->output = worker->output.data;
+}
+
+// What the SUT printed, or the resource limit that stopped it
+undefined_behaviour_t classify_output(Worker *worker, Campaign *campaign, const std::string &output, int status)
+{
+    undefined_behaviour_t error_type = process_output(output);
+
+    // A sanitizer report that came before the limit was hit still counts
+    if (error_type == error || error_type == uncategorized || error_type == no_error)
+    {
+      limit_hit_t limit = limits_check(&worker->limits, status, output);
+      if (limit == limit_memory) {
+        error_type = oom;
+        campaign->ooms++;
+      } else if (limit == limit_cpu) {
+        error_type = cpu_exceeded;
+        campaign->cpu_exceeded++;
+      }
+    }
+    return error_type;
+}
+
+// Triage stage: classify what the SUT printed, save the input if it is
+// interesting and merge its coverage into the campaign's.
+void analyze_result(Worker *worker, Campaign *campaign, ExecResult *result, Feedback *feedback)
+{
+    feedback->gen_strat = result->gen_strat;
+    feedback->found_new_bug = false;
+    feedback->outcome = no_error;
+    feedback->new_arcs = 0;
+    feedback->new_buckets = 0;
+
+    if (verbose) std::cout << "-----------------------------------------------------------------" << std::endl;
+
+    if (!result->finished)
+    {
+      std::cout << "Solver timed out!" << std::endl;
+    }
+    else
+    {
+      const std::string &output_content = result->output;
+      if (verbose) print_file(output_content, "OUTPUT");
+
+      undefined_behaviour_t error_type = classify_output(worker, campaign, output_content, result->status);
+      feedback->outcome = error_type;
+
+      uint64_t hash = crash_signature(output_content, error_type);
+
+      std::lock_guard<std::mutex> lock(campaign->saved_mutex);
+      feedback->found_new_bug = evaluate_input(campaign->saved_inputs, &campaign->signatures, result->input, error_type, hash);
+    }
+
+    std::optional<coverage> &cur_coverage = result->trace;
+    if (!cur_coverage.has_value())
+      return;
 
-    if (solver_future.wait_for(timeout) == std::future_status::timeout)
+    // Merge this worker's counters into the campaign-wide coverage
     {
-        // Timeout occurred, handle it accordingly
-        std::cout << "Solver timed out!" << std::endl;
-        std::string kill_solver = "killall runsat.sh";
-        std::system(kill_solver.c_str());
-        return false;
-    } else {
-        return solver_future.get();
+      std::lock_guard<std::mutex> lock(campaign->coverage_mutex);
+      // Starts out empty, so everything the first trace covers is new
+      if (!campaign->aggregrate_coverage.has_value())
+      {
+        campaign->aggregrate_coverage.emplace();
+        init_coverage(&worker->notes, &campaign->aggregrate_coverage.value());
+      }
+
+      std::optional<coverage_diff> coverage_diff = merge_coverage(&campaign->aggregrate_coverage.value(), &cur_coverage.value());
+      if (coverage_diff.has_value() && !campaign->shared)
+      {
+        feedback->new_arcs = coverage_diff->new_unique_arcs_executed;
+        feedback->new_buckets = coverage_diff->new_hit_buckets;
+      }
     }
+
+    // The shared map is updated atomically, without the lock
+    if (campaign->shared)
+    {
+      coverage_diff global = shared_coverage_merge(&campaign->global_coverage, &cur_coverage.value());
+      feedback->new_arcs = global.new_unique_arcs_executed;
+      feedback->new_buckets = global.new_hit_buckets;
+    }
+
+    if (feedback->new_buckets > 0 && verbose){
+      std::cout << "Discovered " << feedback->new_arcs << " new arcs, " << feedback->new_buckets << " arcs in new hit count buckets." << std::endl;
+    }
+
+    // Inputs that timed out are not worth mutating again
+    queue_update(&campaign->queue, &cur_coverage.value(), feedback->new_buckets > 0 && result->finished, result->input, result->exec_us, result->depth);
+
+    print_coverage_info(&cur_coverage.value());
 }
 
 float check_coverage(std::string path_to_SUT, bool debug) {
@@ -220,59 +342,88 @@ void update_strategy(Strategy *strat) {
 
 
 
-int main(int argc, char *argv[])
+// Set up the scratch directory and gcov redirection of a worker.
+void initialise_worker(Worker *worker, int id, int jobs, int seed, Campaign *campaign)
 {
-    if (argc < 4)
-    {
-        std::cout << "Usage: " << argv[0] << " /path/to/SUT /path/to/inputs seed" << std::endl;
-        return 1;
-    }
-
-    std::string path_to_SUT = argv[1];
-    std::string path_to_inputs = argv[2];
-    std::string seed_input = argv[3];
-    int seed = std::stoi(seed_input);
-    std::cout << std::to_string(argc) << std::endl;
-
-    if (argc == 5)
-    {
-      std::cout << argv[4] << std::endl;
-      std::string argument = argv[4];     
-      verbose = "-verbose" == argument;
-    }
-
-    // Create directory for interesting inputs
-    std::system("rm -rf fuzzed-tests");
-    std::system("mkdir fuzzed-tests");
-
-    // List of wellformed inputs
-    std::list<std::string> inputs;
-
-    for (const auto &entry : std::filesystem::directory_iterator(path_to_inputs))
-        inputs.push_back(entry.path());
+    worker->id = id;
+    worker->jobs = jobs;
+    worker->seed = seed + id;
+
+    // Per process, as instances sharing a coverage map may share a directory
+    worker->dir = std::filesystem::absolute("fuzz-workers/fuzz-sat-" + std::to_string(getpid()) + "/worker-" + std::to_string(id));
+    std::filesystem::create_directories(worker->dir);
+    testcase_open(&worker->testcase, "fuzz-sat-" + std::to_string(getpid()) + "-worker-" + std::to_string(id) + ".cnf", worker->dir);
+    output_init(&worker->output, output_cap);
+    limits_init(&worker->limits, memory_limit_mb, cpu_limit_s, file_size_limit_mb, campaign->sut_binary,
+                "fuzz-sat-" + std::to_string(getpid()) + "-worker-" + std::to_string(id));
+    for (float &ceiling : worker->gen_ceiling)
+      ceiling = GEN_MAX;
+
+    ring_init(&worker->inputs);
+    ring_init(&worker->results);
+    ring_init(&worker->feedback);
+    worker->stats.generate_stall_ns = 0;
+    worker->stats.execute_stall_ns = 0;
+    worker->stats.analyze_stall_ns = 0;
+
+    // Every worker's runs write their own .gcda files, so its delta reads see
+    // its own runs alone. merge_worker_counts adds them to the SUT's files.
+    // GCOV_PREFIX_STRIP removes the SUT's absolute path from the object
+    // paths, so the counters land in the same layout under gcov_prefix.
+    std::filesystem::path sut = std::filesystem::canonical(campaign->path_to_SUT);
+    std::filesystem::path coverage_dir = std::filesystem::canonical(campaign->coverage_dir);
+
+    worker->gcov_prefix = worker->dir + "/gcov";
+    std::filesystem::path sut_components = sut.relative_path();
+    worker->gcov_prefix_strip = std::distance(sut_components.begin(), sut_components.end());
+    worker->count_dir = (std::filesystem::path(worker->gcov_prefix) / coverage_dir.lexically_relative(sut)).lexically_normal();
+    std::filesystem::create_directories(worker->count_dir);
+
+    worker->environment = build_environment(worker, campaign);
+
+    // Only the .gcda counters are re-read against these
+    if (!load_coverage_model(&worker->notes, campaign->coverage_dir, false))
+      std::cout << "Could not read the notes files in " << campaign->coverage_dir << ", no coverage feedback." << std::endl;
+    read_coverage(&worker->notes, false, worker->count_dir);
+
+    // Spare cores help read the .gcda files of multi-object SUTs
+    int cores = std::max(1, (int) std::thread::hardware_concurrency() / jobs);
+    start_coverage_threads(&worker->notes, cores - 1);
+}
 
-    Input saved_inputs[20];
-    initialise_saved_inputs(saved_inputs);
+// Add every worker's counters to the SUT's own .gcda files, which gcov and
+// the scoring read
+void merge_worker_counts(std::vector<Worker> &workers)
+{
+    for (Worker &worker : workers)
+      merge_count_files(&worker.notes, worker.count_dir);
+}
 
-    auto start_time = std::chrono::steady_clock::now();
-    auto end_time = start_time + std::chrono::seconds(FUZZER_TIMEOUT);
+// The workers' directories, once their counters were merged
+void remove_worker_dirs(std::vector<Worker> &workers)
+{
+    std::error_code error;
+    std::filesystem::remove_all(std::filesystem::path(workers[0].dir).parent_path(), error);
+}
 
+// Generator stage. Feedback on an input arrives PIPELINE_DEPTH inputs after
+// it was generated, so the strategy decisions below lag behind by as much.
+void generate_inputs(Worker *worker, Campaign *campaign)
+{
+    // Stagger the starting strategy so workers explore different areas
     Strategy strategy = {
-      .gen_strat = choose_generate_strategy_1_random,
+      .gen_strat = (generation_strategy_t)(worker->id % (int)choose_generate_strategy_end),
       .mut_strat = choose_mutate_strategy_1_nothing, 
       .gen_aggresiveness = 0.6f, 
       .mut_aggresiveness = 0.6f, 
     };
 
-    std::optional<coverage> aggregrate_coverage = {};
-    std::string coverage_dir = std::string(path_to_SUT);
-    // TODO: Remove this condition for release/submission
-    if (path_to_SUT == "solvers/minisat/"){
-      coverage_dir = std::string("solvers/minisat/core");
-    }
+    // Inputs generated that no feedback came back for yet
+    int in_flight = 0;
+    bool stopped = false;
 
     // Main loop
-    while (std::chrono::steady_clock::now() < end_time)
+    while (!stopped && std::chrono::steady_clock::now() < campaign->end_time)
     {
 
         // Number of iterations left for this strategy
@@ -306,50 +457,55 @@ int main(int argc, char *argv[])
             strategy.mut_aggresiveness = MUT_MAX;
           }
 
-      // // std::string generate_new_input(int seed, const Strategy *strat, bool verbose);
-      //     std::packaged_task<std::string(int, const Strategy*, bool)> task(generate_new_input);         
-      //     seed++;
+          // Stay below the size that made this strategy's inputs exhaust the limits
+          if(strategy.gen_aggresiveness >= worker->gen_ceiling[strategy.gen_strat]){
+            strategy.gen_aggresiveness = worker->gen_ceiling[strategy.gen_strat];
+          }
 
-      //     auto future = task.get_future();
-      //     std::thread gen_thread(std::move(task), seed, &strategy, verbose);
+          GeneratedInput generated;
+          std::string queued;
+          uint32_t depth;
+          if (strategy.gen_strat == choose_generate_strategy_10_queue && queue_next(&campaign->queue, &queued, &depth))
+          {
+            // Running a queued input unchanged finds nothing new
+            Strategy mutation = strategy;
+            if (mutation.mut_strat == choose_mutate_strategy_1_nothing)
+              mutation.mut_strat = choose_mutate_strategy_15_controlled_chaos;
+            generated = {mutate_input(std::move(queued), worker->seed, &mutation), strategy.gen_strat, depth + 1};
+          }
+          else
+          {
+            generated = {generate_new_input(worker->seed, &strategy, verbose, &campaign->corpus), strategy.gen_strat, 0};
+          }
+          worker->seed += worker->jobs;
 
-      //     std::string input;
-      //     if(future.wait_for(std::chrono::seconds(5)) != std::future_status::timeout){
-      //       gen_thread.join();
-      //       input = future.get();
-      //     } else {
+          if (!ring_push(&worker->inputs, std::move(generated), &worker->stats.generate_stall_ns)) {
+            stopped = true;
+            break;
+          }
 
-      //       std::cout << " Input generation timed out " << std::endl;
-      //       int err = pthread_kill(gen_thread.native_handle(), 1);
+          // Keep the executor busy while the feedback is on its way
+          if (++in_flight < PIPELINE_DEPTH)
+            continue;
 
-      //       std::cout << " Managed to kill thread: " << err << std::endl;
-      //       break;
-      //     }
-      
-          bool found_new_bug = run_solver_with_timeout(path_to_SUT, saved_inputs, generate_new_input(seed++, &strategy, verbose) , std::chrono::seconds(SUT_TIMEOUT));
+          Feedback feedback;
+          if (!ring_pop(&worker->feedback, &feedback, &worker->stats.generate_stall_ns)) {
+            stopped = true;
+            break;
+          }
+          in_flight--;
 
           // We found a new bug with the current strategy, try for longer:
-          if (found_new_bug){
+          if (feedback.found_new_bug){
             strat_iterations_left += 10;
           }
 
-
-          if(aggregrate_coverage.has_value() == false){
-            aggregrate_coverage = arc_coverage_all_files(coverage_dir, false);
+          // Inputs this large exhaust the SUT's memory or CPU, generate smaller ones
+          if (feedback.outcome == oom || feedback.outcome == cpu_exceeded){
+            worker->gen_ceiling[feedback.gen_strat] = std::max(GEN_START, strategy.gen_aggresiveness * RESOURCE_BACKOFF);
           }
 
-          coverage cur_coverage = *arc_coverage_all_files(coverage_dir, false);
-          coverage_diff coverage_diff = *calc_coverage_diff(&aggregrate_coverage.value(), &cur_coverage);
-          calc_aggregrate_coverage(&aggregrate_coverage.value(), &cur_coverage);
-          uint32_t new_arcs_discovered = coverage_diff.new_unique_arcs_executed;
-          
-          if (new_arcs_discovered > 0 && verbose){
-            std::cout << "Discovered " << new_arcs_discovered << " new arcs." << std::endl;
-          }
-
-          print_coverage_info(&cur_coverage);
-          
-          new_coverage_fifo.push_front(new_arcs_discovered);
+          new_coverage_fifo.push_front(feedback.new_buckets);
 
           int new_coverage_recently = 0;
           if (new_coverage_fifo.size() > FIFO_SIZE) {
@@ -387,20 +543,454 @@ int main(int argc, char *argv[])
 
         // Update strategy when coverage becomes stagnant
         update_strategy(&strategy);
+    }
 
-        // Total time for fuzzing elapsed
-        if (std::chrono::steady_clock::now() >= end_time)
-            break;
+    ring_close(&worker->inputs);
+}
+
+void triage_results(Worker *worker, Campaign *campaign)
+{
+    ExecResult result;
+    while (ring_pop(&worker->results, &result, &worker->stats.analyze_stall_ns))
+    {
+      Feedback feedback;
+      analyze_result(worker, campaign, &result, &feedback);
+
+      // Never blocks, the generator waits for feedback whenever
+      // PIPELINE_DEPTH inputs are in flight
+      ring_push(&worker->feedback, std::move(feedback), &worker->stats.analyze_stall_ns);
+    }
+
+    ring_close(&worker->feedback);
+}
+
+// The SUT is started once and its solver forks for every input
+void start_forkserver(Worker *worker, Campaign *campaign)
+{
+    worker->forkserver.running = false;
+    if (use_forkserver)
+    {
+      std::string server_dir = campaign->direct ? std::filesystem::path(campaign->sut_binary).parent_path().string() : campaign->path_to_SUT;
+      forkserver_start(&worker->forkserver, sut_command(worker, campaign), campaign->sut_binary, server_dir, worker->environment, &worker->testcase, &worker->limits);
+    }
+}
+
+// Executor stage, on the worker's own thread, with the generator and triage
+// stages on two more.
+void fuzz_worker(Worker *worker, Campaign *campaign)
+{
+    start_forkserver(worker, campaign);
+
+    std::thread generator(generate_inputs, worker, campaign);
+    std::thread triage(triage_results, worker, campaign);
+
+    GeneratedInput generated;
+    while (ring_pop(&worker->inputs, &generated, &worker->stats.execute_stall_ns))
+    {
+      // Total time for fuzzing elapsed
+      if (std::chrono::steady_clock::now() >= campaign->end_time)
+        break;
+
+      ExecResult result;
+      run_solver(worker, campaign, &generated, &result);
+      if (!ring_push(&worker->results, std::move(result), &worker->stats.execute_stall_ns))
+        break;
+    }
+
+    // Stops the generator, and triage once it has analysed what is queued
+    ring_close(&worker->inputs);
+    ring_close(&worker->results);
+
+    generator.join();
+    triage.join();
+
+    forkserver_stop(&worker->forkserver);
+    testcase_close(&worker->testcase);
+    limits_close(&worker->limits);
+}
+
+// Corpus minimisation: each worker runs the next input of the corpus that
+// is left, and keeps its coverage
+void cmin_worker(Worker *worker, Campaign *campaign, std::vector<cmin_input> *inputs, std::atomic<size_t> *next)
+{
+    start_forkserver(worker, campaign);
+
+    size_t index;
+    while ((index = (*next)++) < inputs->size())
+    {
+      std::string_view input = corpus_seed_data(&campaign->corpus, index);
+      testcase_write(&worker->testcase, std::string(input));
+      corpus_release(&campaign->corpus, index);
+
+      int status;
+      auto start = std::chrono::steady_clock::now();
+      bool finished = execute_testcase(worker, campaign, campaign->timeouts.limit, &status);
+      auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+      // Hangs are left out of the cover
+      std::optional<coverage> trace = read_coverage(&worker->notes, false, worker->count_dir);
+      if (finished && trace.has_value())
+        cmin_features(&(*inputs)[index], &trace.value(), input.size(), time.count());
+      else if (verbose)
+        std::cout << campaign->corpus.seeds[index].path << " timed out, leaving it out." << std::endl;
+    }
+
+    forkserver_stop(&worker->forkserver);
+    testcase_close(&worker->testcase);
+    limits_close(&worker->limits);
+}
+
+// Copy a subset of the corpus that covers all the corpus covers to output_dir
+int minimize_corpus(std::vector<Worker> &workers, Campaign *campaign, std::string output_dir)
+{
+    std::vector<cmin_input> inputs(campaign->corpus.seeds.size());
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> threads;
+    for (Worker &worker : workers)
+      threads.emplace_back(cmin_worker, &worker, campaign, &inputs, &next);
+    for (auto &thread : threads)
+      thread.join();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<size_t> chosen = cmin_select(inputs, workers[0].notes.arc_slots / sizeof(uint64_t));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::filesystem::create_directories(output_dir);
+    coverage kept;
+    init_coverage(&workers[0].notes, &kept);
+    for (size_t index : chosen)
+    {
+      std::filesystem::path path = campaign->corpus.seeds[index].path;
+      std::filesystem::copy_file(path, std::filesystem::path(output_dir) / path.filename(), std::filesystem::copy_options::overwrite_existing);
+      for (size_t i = 0; i < inputs[index].words.size(); i++)
+      {
+        uint8_t *bytes = &kept.arc_hits.bytes[inputs[index].word_index[i] * sizeof(uint64_t)];
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(uint64_t));
+        word |= inputs[index].words[i];
+        std::memcpy(bytes, &word, sizeof(uint64_t));
+      }
+    }
+
+    size_t arcs = 0;
+    for (uint8_t buckets : kept.arc_hits.bytes)
+      arcs += buckets != 0;
+    std::cout << "Kept " << chosen.size() << " of " << inputs.size() << " inputs ("
+              << campaign->corpus.duplicates << " duplicates left out), covering " << arcs << " arcs, in "
+              << elapsed << "s of set cover." << std::endl;
+
+    merge_worker_counts(workers);
+    remove_worker_dirs(workers);
+    for (Worker &worker : workers)
+      free_coverage_model(&worker.notes);
+    corpus_close(&campaign->corpus);
+    return 0;
+}
+
+// Run candidates across the workers, each taking the next one left, and
+// return the index of the first that fails with type and signature
+size_t tmin_run(std::vector<Worker> &workers, Campaign *campaign, const std::vector<std::string> &candidates,
+                undefined_behaviour_t type, uint64_t signature, std::chrono::milliseconds timeout)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> found(SIZE_MAX);
+
+    auto run = [&](Worker *worker) {
+      size_t index;
+      // Candidates after one that fails need not run
+      while ((index = next++) < candidates.size() && index < found)
+      {
+        testcase_write(&worker->testcase, candidates[index]);
+        int status;
+        if (!execute_testcase(worker, campaign, timeout, &status))
+          continue;
+        const std::string &output = worker->output.data;
+        undefined_behaviour_t candidate_type = classify_output(worker, campaign, output, status);
+        if (candidate_type != type || crash_signature(output, candidate_type) != signature)
+          continue;
+
+        size_t first = found;
+        while (index < first && !found.compare_exchange_weak(first, index));
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers.size() && i < candidates.size(); i++)
+      threads.emplace_back(run, &workers[i]);
+    run(&workers[0]);
+    for (auto &thread : threads)
+      thread.join();
+
+    return found;
+}
+
+// Shrink the input at input_path into output_path, keeping the class of the
+// failure and its crash signature
+int minimize_testcase(std::vector<Worker> &workers, Campaign *campaign, std::string input_path, std::string output_path)
+{
+    std::ifstream file(input_path, std::ios::binary);
+    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file)
+    {
+      std::cout << "Could not read " << input_path << std::endl;
+      remove_worker_dirs(workers);
+      return 1;
+    }
+
+    for (Worker &worker : workers)
+      start_forkserver(&worker, campaign);
+
+    Worker *worker = &workers[0];
+    testcase_write(&worker->testcase, input);
+    int status;
+    auto start = std::chrono::steady_clock::now();
+    bool finished = execute_testcase(worker, campaign, campaign->timeouts.limit, &status);
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    undefined_behaviour_t type = finished ? classify_output(worker, campaign, worker->output.data, status) : no_error;
+    std::string site = crash_site(worker->output.data);
+    uint64_t signature = crash_signature(worker->output.data, type);
+
+    int result = 0;
+    if (type == no_error || type == uncategorized)
+    {
+      std::cout << input_path << " does not fail, nothing to minimise." << std::endl;
+      result = 1;
+    }
+    else
+    {
+      std::cout << "Minimising " << input_path << ", type " << type << " at " << (site.empty() ? "no report" : site) << std::endl;
+
+      // Smaller inputs rarely run longer, and candidates that hang are
+      // rejected sooner
+      std::chrono::milliseconds timeout = std::min(campaign->timeouts.limit, time * 2 + std::chrono::milliseconds(1000));
+      uint64_t execs = campaign->execs;
+      std::string minimised = tmin_minimize(input, workers.size(), [&](const std::vector<std::string> &candidates) {
+        return tmin_run(workers, campaign, candidates, type, signature, timeout);
+      }, [](tmin_level level, size_t size) {
+        static const char *level_names[] = {"lines", "literals", "bytes"};
+        if (verbose) std::cout << "Minimised by " << level_names[level] << ": " << size << " bytes left" << std::endl;
+      });
+
+      create_file(output_path, minimised);
+      std::cout << "Minimised " << input.size() << " to " << minimised.size() << " bytes in "
+                << campaign->execs - execs << " execs, written to " << output_path << std::endl;
+    }
+
+    for (Worker &worker : workers)
+    {
+      forkserver_stop(&worker.forkserver);
+      testcase_close(&worker.testcase);
+      limits_close(&worker.limits);
+    }
+    merge_worker_counts(workers);
+    remove_worker_dirs(workers);
+    for (Worker &worker : workers)
+      free_coverage_model(&worker.notes);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // fuzz-sat --cmin runs a corpus rather than fuzzing, keeping a subset of
+    // it that covers as much. fuzz-sat --tmin shrinks one failing input.
+    std::string mode = argc > 1 ? argv[1] : "";
+    bool cmin = mode == "--cmin";
+    bool tmin = mode == "--tmin";
+    int first = cmin || tmin ? 2 : 1;
+    if (argc < first + 3)
+    {
+        std::cout << "Usage: " << argv[0] << " [--cmin | --tmin] /path/to/SUT (/path/to/inputs | /path/to/input) (seed | /path/to/output) [-verbose] [-j workers (default 1, all cores with --cmin or --tmin)] [-no-forkserver] [-direct] [-sut-binary path] [-output-cap bytes] [-memory-limit MB] [-cpu-limit seconds] [-file-size-limit MB] [-coverage-map path] [-merge-map path] [-shared-map name]" << std::endl;
+        return 1;
+    }
+
+    std::string path_to_SUT = argv[first];
+    std::string path_to_inputs = argv[first + 1];
+    std::string seed_input = argv[first + 2];
+    int seed = cmin || tmin ? 0 : std::stoi(seed_input);
+    std::cout << std::to_string(argc) << std::endl;
+
+    Campaign campaign;
+    campaign.path_to_SUT = path_to_SUT;
+    campaign.direct = false;
+    std::string sut_binary;
+
+    int jobs = 0;
+    std::vector<std::string> merge_maps;
+    for (int i = first + 3; i < argc; i++)
+    {
+      std::cout << argv[i] << std::endl;
+      std::string argument = argv[i];
+
+      if (argument == "-verbose") {
+        verbose = true;
+      } else if (argument == "-no-forkserver") {
+        use_forkserver = false;
+      } else if (argument == "-direct") {
+        campaign.direct = true;
+      } else if (argument == "-sut-binary" && i + 1 < argc) {
+        campaign.direct = true;
+        sut_binary = argv[++i];
+      } else if (argument == "-output-cap" && i + 1 < argc) {
+        output_cap = std::max(2L, std::stol(argv[++i]));
+      } else if (argument == "-memory-limit" && i + 1 < argc) {
+        memory_limit_mb = std::stoul(argv[++i]);
+      } else if (argument == "-cpu-limit" && i + 1 < argc) {
+        cpu_limit_s = std::max(0, std::stoi(argv[++i]));
+      } else if (argument == "-file-size-limit" && i + 1 < argc) {
+        file_size_limit_mb = std::stoul(argv[++i]);
+      } else if (argument == "-coverage-map" && i + 1 < argc) {
+        campaign.coverage_map = argv[++i];
+      } else if (argument == "-merge-map" && i + 1 < argc) {
+        merge_maps.push_back(argv[++i]);
+      } else if (argument == "-shared-map" && i + 1 < argc) {
+        campaign.shared_name = argv[++i];
+      } else if (argument == "-j" && i + 1 < argc) {
+        jobs = std::max(1, std::stoi(argv[++i]));
+      } else {
+        std::cout << "Unknown argument: " << argument << std::endl;
+        return 1;
+      }
+    }
+    // Minimising has no long campaign to share the machine with
+    if (jobs == 0)
+      jobs = cmin || tmin ? std::max(1, (int) std::thread::hardware_concurrency()) : 1;
+
+    // Create directory for interesting inputs, which may be the corpus to
+    // minimise
+    if (!cmin && !tmin)
+    {
+      std::system("rm -rf fuzzed-tests");
+      std::system("mkdir fuzzed-tests");
+    }
+
+    // Wellformed inputs for the mutation strategies to start from
+    if (!tmin && corpus_open(&campaign.corpus, path_to_inputs))
+      std::cout << "Seed corpus: " << campaign.corpus.seeds.size() << " seeds, "
+                << campaign.corpus.duplicates << " duplicates left out." << std::endl;
+
+    // Find the solver and the sanitizer options runsat.sh uses
+    if (!read_runsat(path_to_SUT, &campaign.sut_binary, &campaign.sut_exports))
+    {
+      if (campaign.direct && sut_binary.empty())
+        std::cout << "Could not find the solver in runsat.sh, running the SUT through runsat.sh." << std::endl;
+      if (sut_binary.empty())
+        campaign.direct = false;
     }
+    if (campaign.sut_exports.empty())
+      campaign.sut_exports = {DEFAULT_UBSAN_OPTIONS, DEFAULT_ASAN_OPTIONS};
+    if (!sut_binary.empty())
+      campaign.sut_binary = std::filesystem::absolute(sut_binary);
+
+    initialise_saved_inputs(campaign.saved_inputs);
+    signature_set_init(&campaign.signatures);
+    timeouts_init(&campaign.timeouts, choose_generate_strategy_end, std::chrono::seconds(SUT_TIMEOUT));
+    campaign.execs = 0;
+    campaign.ooms = 0;
+    campaign.cpu_exceeded = 0;
+
+    auto start_time = std::chrono::steady_clock::now();
+    campaign.end_time = start_time + std::chrono::seconds(FUZZER_TIMEOUT);
+
+    campaign.coverage_dir = std::string(path_to_SUT);
+
+    std::vector<Worker> workers(jobs);
+    for (int i = 0; i < jobs; i++)
+      initialise_worker(&workers[i], i, jobs, seed, &campaign);
+    if (cmin)
+      return minimize_corpus(workers, &campaign, seed_input);
+    if (tmin)
+      return minimize_testcase(workers, &campaign, path_to_inputs, seed_input);
+    queue_init(&campaign.queue, workers[0].notes.arc_slots);
+
+    // Start from the coverage of earlier campaigns, so it is not reported as
+    // new again. Every worker's notes are laid out the same, so any of them
+    // can map the aggregate.
+    if (std::filesystem::exists(campaign.coverage_map))
+      merge_maps.insert(merge_maps.begin(), campaign.coverage_map);
+    for (const std::string &map : merge_maps)
+    {
+      if (!campaign.aggregrate_coverage.has_value())
+      {
+        campaign.aggregrate_coverage.emplace();
+        init_coverage(&workers[0].notes, &campaign.aggregrate_coverage.value());
+      }
+      if (load_coverage_map(&workers[0].notes, &campaign.aggregrate_coverage.value(), map))
+        std::cout << "Loaded coverage map " << map << ", " << campaign.aggregrate_coverage->arcs_executed << " arcs covered." << std::endl;
+    }
+
+    campaign.shared = false;
+    if (!campaign.shared_name.empty())
+    {
+      campaign.shared = shared_coverage_open(&campaign.global_coverage, campaign.shared_name, &workers[0].notes);
+      if (!campaign.shared)
+        std::cout << "Judging coverage by this instance alone." << std::endl;
+      else if (campaign.aggregrate_coverage.has_value())
+        shared_coverage_merge(&campaign.global_coverage, &campaign.aggregrate_coverage.value());
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobs; i++)
+      threads.emplace_back(fuzz_worker, &workers[i], &campaign);
+
+    // Report the execution rate while the workers run
+    while (std::chrono::steady_clock::now() < campaign.end_time)
+    {
+      std::this_thread::sleep_for(std::chrono::seconds(STATS_INTERVAL));
+
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+      uint64_t execs = campaign.execs;
+      std::cout << "Stats: " << jobs << " workers, " << execs << " execs, "
+                << execs / elapsed << " execs/s, " << campaign.ooms << " oom, "
+                << campaign.cpu_exceeded << " cpu-exceeded, " << queue_size(&campaign.queue) << " queued" << std::endl;
+
+      // Where the workers' pipelines wait, summed over the workers
+      size_t to_execute = 0, to_analyze = 0;
+      double generate_stall = 0, execute_stall = 0, analyze_stall = 0;
+      for (Worker &worker : workers)
+      {
+        to_execute += ring_size(&worker.inputs);
+        to_analyze += ring_size(&worker.results);
+        generate_stall += worker.stats.generate_stall_ns / 1e9;
+        execute_stall += worker.stats.execute_stall_ns / 1e9;
+        analyze_stall += worker.stats.analyze_stall_ns / 1e9;
+      }
+      std::cout << "Pipeline: " << to_execute << " queued to execute, " << to_analyze << " to analyze, stalled "
+                << generate_stall << "s generating, " << execute_stall << "s executing, "
+                << analyze_stall << "s analyzing" << std::endl;
+
+      // Campaigns are often stopped rather than run to the end
+      merge_worker_counts(workers);
+      if (!campaign.coverage_map.empty())
+      {
+        std::lock_guard<std::mutex> lock(campaign.coverage_mutex);
+        if (campaign.aggregrate_coverage.has_value())
+          save_coverage_map(&workers[0].notes, &campaign.aggregrate_coverage.value(), campaign.coverage_map);
+      }
+    }
+
+    for (auto &thread : threads)
+      thread.join();
+
+    merge_worker_counts(workers);
+    remove_worker_dirs(workers);
+    if (!campaign.coverage_map.empty() && campaign.aggregrate_coverage.has_value())
+      save_coverage_map(&workers[0].notes, &campaign.aggregrate_coverage.value(), campaign.coverage_map);
+    for (Worker &worker : workers)
+      free_coverage_model(&worker.notes);
+    if (campaign.shared)
+      shared_coverage_close(&campaign.global_coverage);
+    corpus_close(&campaign.corpus);
 
     // Once working will need to check coverage every loop
     // to make decisions on exploration vs exploitation   
     std::cout << "Aggregrate Coverage: " << std::endl;
-    print_coverage_info(&aggregrate_coverage.value());
+    if (campaign.aggregrate_coverage.has_value())
+      print_coverage_info(&campaign.aggregrate_coverage.value());
   
     //Print info about saved inputs  
-    export_inputs_info(saved_inputs);
+    export_inputs_info(campaign.saved_inputs);
   
     return 0;
 }
-
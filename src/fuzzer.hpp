@@ -5,6 +5,7 @@
 #include <chrono>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <fstream>
@@ -12,12 +13,25 @@
 #include <algorithm>
 #include <tuple>
 #include <deque>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "generate.hpp"
 #include "process_output.hpp"
+#include "coverage.hpp"
+#include "shared_coverage.hpp"
+#include "forkserver.hpp"
+#include "launch.hpp"
+#include "timeout.hpp"
+#include "pipeline.hpp"
+#include "queue.hpp"
+#include "signature_set.hpp"
 
 #ifndef FUZZER_HPP
 #define FUZZER_HPP
@@ -26,9 +40,129 @@ typedef struct
 { 
   int priority;
   undefined_behaviour_t type;
-  std::size_t hash;
+  // crash_signature of what the SUT printed
+  uint64_t hash;
 } Input;
 
+// State shared by every worker of a fuzzing campaign
+typedef struct
+{
+  std::string path_to_SUT;
+  std::string coverage_dir;
+
+  // Exec the solver directly instead of going through runsat.sh
+  bool direct;
+  std::string sut_binary;
+  // Variables runsat.sh exports for the solver
+  std::vector<std::string> sut_exports;
+
+  // Files of the inputs directory
+  seed_corpus corpus;
+  // Inputs that added coverage, to be mutated again
+  input_queue queue;
+
+  Input saved_inputs[20];
+  // Signatures of every output so far, held with saved_mutex as well
+  signature_set signatures;
+  std::mutex saved_mutex;
+
+  std::optional<coverage> aggregrate_coverage;
+  std::mutex coverage_mutex;
+  // Loaded before and saved after the campaign, when set
+  std::string coverage_map;
+  // Coverage of every instance on this machine, when shared_name is set.
+  // Inputs then only count as new if they are new to all of them.
+  std::string shared_name;
+  bool shared;
+  shared_coverage global_coverage;
+
+  // Per-strategy SUT timeouts
+  TimeoutModel timeouts;
+
+  std::atomic<uint64_t> execs;
+  // Executions stopped by a resource limit
+  std::atomic<uint64_t> ooms;
+  std::atomic<uint64_t> cpu_exceeded;
+  std::chrono::steady_clock::time_point end_time;
+} Campaign;
+
+// A test case on its way from the generator to the executor
+typedef struct
+{
+  std::string input;
+  generation_strategy_t gen_strat;
+  // Mutations away from a generated input or seed
+  uint32_t depth;
+} GeneratedInput;
+
+// One execution, on its way from the executor to triage
+typedef struct
+{
+  std::string input;
+  generation_strategy_t gen_strat;
+  uint32_t depth;
+
+  // False if the SUT timed out
+  bool finished;
+  int status;
+  uint32_t exec_us;
+  std::string output;
+  // Coverage of this execution alone
+  std::optional<coverage> trace;
+} ExecResult;
+
+// What triage found out about one input, back to the generator
+typedef struct
+{
+  generation_strategy_t gen_strat;
+  bool found_new_bug;
+  undefined_behaviour_t outcome;
+  uint32_t new_arcs;
+  // Arcs hit a number of times no earlier input did
+  uint32_t new_buckets;
+} Feedback;
+
+// A worker runs its own SUT executions. Every worker has its own in-memory
+// test case and output buffer, and (except worker 0, which keeps writing the
+// SUT's own .gcda files) a private GCOV_PREFIX under its scratch directory so
+// that counters of concurrent runs never mix.
+typedef struct
+{
+  int id;
+  int jobs;
+  int seed;
+
+  std::string dir;
+  TestCase testcase;
+
+  // What the SUT printed in the last execution
+  OutputBuffer output;
+
+  // Empty when the SUT writes its .gcda files in place.
+  std::string gcov_prefix;
+  int gcov_prefix_strip;
+
+  // Where this worker's .gcda files can be read back from.
+  std::string count_dir;
+  // Flow graphs of the SUT's objects, read once from their .gcno files
+  coverage_model notes;
+
+  std::vector<std::string> environment;
+  ResourceLimits limits;
+
+  Forkserver forkserver;
+
+  // Generator -> executor -> triage, and the feedback back to the generator
+  Ring<GeneratedInput> inputs;
+  Ring<ExecResult> results;
+  Ring<Feedback> feedback;
+  PipelineStats stats;
+
+  // Generation aggressiveness each strategy is held below after its inputs
+  // hit a resource limit
+  float gen_ceiling[choose_generate_strategy_end];
+} Worker;
+
 
 void create_file(std::string filename, std::string content)
 {
@@ -59,9 +193,4 @@ void export_inputs_info(Input *saved) {
   std::cout << out << std::endl;
 }
 
-std::size_t get_hash(std::string output) {
-  std::hash<std::string> hasher; 
-  return hasher(output); 
-}
-
 #endif
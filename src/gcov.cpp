@@ -1,97 +1,267 @@
 #include "gcov.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
-#include <optional>
+#include <new>
+#include <cstring>
 #include <stdint.h>
 #include <stdio.h>
 #include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+	The notes and count files are mapped whole and their records walked in
+	place, rather than issuing a read for every word.
+
+	int32:  byte3 byte2 byte1 byte0 | byte0 byte1 byte2 byte3
+	int64:  int32:low int32:high
+	string: int32:0 | int32:length char* char:0 padding
+	padding: | char:0 | char:0 char:0 | char:0 char:0 char:0
+	item: int32 | int64 | string
+
+	The basic format of the files is:
+
+	file : int32:magic int32:version int32:stamp [int32:checksum] record*
+
+	A record has a tag, length and variable amount of data:
+
+	record: header data
+	header: int32:tag int32:length
+	data: item*
+
+	Up to GCC 11 lengths count words and strings are padded to a word. From
+	GCC 12 on lengths count bytes, strings are not padded (their length
+	includes the terminating NUL) and the header carries a checksum. A counter
+	record with a negative length stands for that many counters, all zero.
+*/
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+
+	// Written by GCC 12 or later
+	bool bytes;
+	// Read past the end of the file
+	bool error;
+} gcov_reader;
+
+// The version is four characters, e.g. "B22*" for GCC 12.2
+static uint32_t gcc_major(uint32_t version) {
+	return ((version >> 24) - 'A') * 10 + (((version >> 16) & 0xff) - '0');
+}
 
-std::optional<void*> read_bytes(FILE* fd, void* buf, uint32_t count){
-	uint32_t read = fread(buf, count, 1, fd);
-	if (read != 1){
-		return {};
+static bool map_file(gcov_reader *reader, int fd) {
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return false;
 	}
-	
-	return buf;
+
+	reader->size = st.st_size;
+	reader->pos = 0;
+	reader->bytes = false;
+	reader->error = false;
+	reader->data = NULL;
+	if (reader->size == 0) {
+		return true;
+	}
+
+	void *data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	reader->data = (const uint8_t *) data;
+	return true;
 }
 
-std::optional<uint32_t> read_uint32(FILE* fd) {
-	uint32_t buf [1];
-	std::optional<void*> res = read_bytes(fd, &buf, 4); 
+static void unmap_file(gcov_reader *reader) {
+	if (reader->data) {
+		munmap((void *) reader->data, reader->size);
+	}
+	reader->data = NULL;
+}
 
-	if (res.has_value()){
-		return *(uint32_t*)res.value();
-	} else {
-		return {};
+static uint32_t read_uint32(gcov_reader *reader) {
+	if (reader->pos + 4 > reader->size) {
+		reader->error = true;
+		reader->pos = reader->size;
+		return 0;
+	}
+
+	uint32_t value;
+	memcpy(&value, reader->data + reader->pos, 4);
+	reader->pos += 4;
+	return value;
+}
+
+static std::string read_string(gcov_reader *reader) {
+	size_t length = read_uint32(reader);
+	if (!reader->bytes) {
+		length *= 4;
 	}
+
+	if (reader->pos + length > reader->size) {
+		reader->error = true;
+		reader->pos = reader->size;
+		return "";
+	}
+
+	// Drop the terminating NUL and padding
+	const char *str = (const char *) reader->data + reader->pos;
+	reader->pos += length;
+	return std::string(str, strnlen(str, length));
 }
 
-std::optional<std::string> read_string(FILE* fd) {
+// A record length in bytes. Negative for counter records that were all zero.
+static int64_t record_length(gcov_reader *reader, uint32_t length) {
+	int64_t signed_length = (int32_t) length;
+	return reader->bytes ? signed_length : signed_length * 4;
+}
 
-	auto length = read_uint32(fd);
-	// printf("Reading string of length: %i\n", length);
-	
-	if(!length.has_value()){
-		return {};
+// Magic, version, stamp and, from GCC 12 on, the checksum
+static bool read_header(gcov_reader *reader, std::string file_name, uint32_t expected_magic) {
+	uint32_t magic = read_uint32(reader);
+	if (reader->error || magic != expected_magic) {
+		printf("%s is not a gcov file. Header is %x, expected %x\n", file_name.c_str(), magic, expected_magic);
+		return false;
 	}
-	
-	std::string str;
-	str.resize((*length) * 4);
 
-	auto res = read_bytes(fd, &str[0], (*length) * 4);
-	if (res.has_value()){
-		
-		// printf("Read string: %s\n", str.c_str());
-		return str;
-	} else {
-		return {};
+	uint32_t version = read_uint32(reader);
+	read_uint32(reader); // stamp
+	reader->bytes = gcc_major(version) >= 12;
+	if (reader->bytes) {
+		read_uint32(reader); // checksum
 	}
 
+	if (reader->error) {
+		printf("Could not read version, stamp or checksum\n");
+		return false;
+	}
+	return true;
 }
 
-int read_notes_file(std::string notes_file_name, std::vector<function_info_t*>* functions, std::map<uint32_t, function_info_t *>* ident_to_fn) {
-	
-	FILE* notes_fd = fopen(notes_file_name.c_str(), "rb"); 
-	if (notes_fd == NULL){
-		printf("Could not open data file: %s", notes_file_name.c_str());
+// Add count little-endian int64 counters at src to dst. Plain loads and an
+// add per counter, so the compiler vectorizes it.
+static void add_counters(int64_t *dst, const uint8_t *src, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		uint32_t low, high;
+		memcpy(&low, src + i * 8, 4);
+		memcpy(&high, src + i * 8 + 4, 4);
+		dst[i] += (int64_t) (((uint64_t) high << 32) | low);
 	}
+}
 
-	// Gcov checks for endianness before parsing - since this will be built from source
-	// I think we can avoid it.
+// Chunks hold the graphs of several small functions, larger requests get
+// their own
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+void *arena_alloc(gcov_arena *arena, size_t size, size_t align) {
+	size_t padding = arena->left > 0 ? (align - (uintptr_t) arena->next % align) % align : 0;
+	if (arena->chunks.empty() || padding + size > arena->left) {
+		size_t chunk_size = std::max((size_t) ARENA_CHUNK_SIZE, size + align);
+		char *chunk = (char *) calloc(1, chunk_size);
+		if (!chunk) {
+			throw std::bad_alloc();
+		}
+		arena->chunks.push_back(chunk);
+		arena->next = chunk;
+		arena->left = chunk_size;
+		padding = (align - (uintptr_t) chunk % align) % align;
+	}
 
-	if(auto magic = read_uint32(notes_fd)) {
-		if (*magic != GCOV_NOTE_MAGIC){
-			printf("%s is note a gcov note file. Header is %x, expected %x\n", notes_file_name.c_str(), *magic, GCOV_NOTE_MAGIC);
-			return 1;
+	char *memory = arena->next + padding;
+	arena->next += padding + size;
+	arena->left -= padding + size;
+	return memory;
+}
+
+void arena_free(gcov_arena *arena) {
+	for (char *chunk : arena->chunks) {
+		free(chunk);
+	}
+	arena->chunks.clear();
+	arena->next = NULL;
+	arena->left = 0;
+}
+
+// Count the arcs in the records of the function whose announcement the
+// reader just passed, without moving the reader
+static uint32_t count_function_arcs(const gcov_reader *reader) {
+	gcov_reader ahead = *reader;
+	uint32_t arcs = 0;
+
+	while (ahead.pos + 8 <= ahead.size) {
+		uint32_t tag = read_uint32(&ahead);
+		int64_t length = record_length(&ahead, read_uint32(&ahead));
+		if (!GCOV_TAG_IS_SUBTAG(GCOV_TAG_FUNCTION, tag) || length < 4) {
+			break;
 		}
-	} else {
+		if (tag == GCOV_TAG_ARCS) {
+			arcs += (length / 4 - 1) / 2;
+		}
+		ahead.pos += length;
+	}
+	return arcs;
+}
+
+// List the entry arcs of every block, once all arcs of fn are read
+static void link_predecessors(gcov_arena *arena, function_info_t *fn) {
+	for (uint32_t arc = 0; arc < fn->num_arcs; arc++) {
+		fn->blocks[fn->arc_dst[arc]].pred_end++;
+	}
+
+	uint32_t start = 0;
+	for (uint32_t ix = 0; ix < fn->num_blocks; ix++) {
+		uint32_t preds = fn->blocks[ix].pred_end;
+		fn->blocks[ix].pred_begin = start;
+		fn->blocks[ix].pred_end = start;
+		start += preds;
+	}
+
+	fn->pred_arcs = arena_array<uint32_t>(arena, fn->num_arcs);
+	for (uint32_t arc = 0; arc < fn->num_arcs; arc++) {
+		block_info *dst = &fn->blocks[fn->arc_dst[arc]];
+		fn->pred_arcs[dst->pred_end++] = arc;
+	}
+}
+
+int read_notes_file(std::string notes_file_name, gcov_arena* arena, std::vector<function_info_t*>* functions, std::map<uint32_t, function_info_t *>* ident_to_fn) {
+	
+	int notes_fd = open(notes_file_name.c_str(), O_RDONLY | O_CLOEXEC); 
+	if (notes_fd < 0){
+		printf("Could not open data file: %s\n", notes_file_name.c_str());
 		return 1;
 	}
 
-	auto version = read_uint32(notes_fd);
-	auto stamp = read_uint32(notes_fd);
-	// auto checksum = read_uint32(notes_fd);
-	uint32_t current_tag = 0;
+	gcov_reader reader;
+	bool mapped = map_file(&reader, notes_fd);
+	close(notes_fd);
+	if (!mapped) {
+		printf("Could not map %s\n", notes_file_name.c_str());
+		return 1;
+	}
 
-	if(!version.has_value() || !stamp.has_value() ){
-	// if(!version.has_value() || !stamp.has_value() || !checksum.has_value()){
-		printf("Could not read version, stamp or checksum\n");
+	int result = 1;
+
+	// Gcov checks for endianness before parsing - since this will be built from source
+	// I think we can avoid it.
+	if (!read_header(&reader, notes_file_name, GCOV_NOTE_MAGIC)) {
+		unmap_file(&reader);
 		return 1;
 	}
 
-	if(auto work_dir = read_string(notes_fd)){
-		;
-		// printf("Working directory: %s\n", (*work_dir).c_str());
-	} else {
+	read_string(&reader); // work_dir
+	read_uint32(&reader); // unexecuted blocks
+	if (reader.error) {
 		printf("Could not read working directory.\n");
+		unmap_file(&reader);
 		return 1;
 	}
 	
-	// read_uint32(notes_fd);
-	auto unexecuted_blocks __attribute__((unused))= read_uint32(notes_fd);
-	// printf("Unexec blocks: %i\n", unexecuted_blocks);
-	
 	/*
 	The basic block graph file contains the following records
 	   	note: unit function-graph*
@@ -106,260 +276,227 @@ int read_notes_file(std::string notes_file_name, std::vector<function_info_t*>*
 	               int32:0 string:NULL
 		line:  int32:line_no | int32:0 string:filename
 	*/
-
-	/*
-		int32:  byte3 byte2 byte1 byte0 | byte0 byte1 byte2 byte3
-		int64:  int32:low int32:high
-		string: int32:0 | int32:length char* char:0 padding
-		padding: | char:0 | char:0 char:0 | char:0 char:0 char:0
-		item: int32 | int64 | string
-
-		The basic format of the files is:
-
-	   	file : int32:magic int32:version int32:stamp int32:checksum string:work_dir int32:unexec record*
-
-		A record has a tag, length and variable amount of data:
-
-		record: header data
-		header: int32:tag int32:length
-		data: item*
-	*/
 	
 	// Go through every record in the file
 	
 	function_info_t *fn = NULL;
-	while (auto tag = *read_uint32(notes_fd)){
-		auto length = read_uint32(notes_fd);
-		auto base_pos __attribute__((unused)) = ftell(notes_fd);
-
-		// printf("Tag: %x\n", tag);
-		
-		if (feof(notes_fd)) {
-			// printf("Reached EOF\n");
+	// Arcs allocated for fn
+	uint32_t arc_capacity = 0;
+	uint32_t current_tag = 0;
+	while (reader.pos + 8 <= reader.size) {
+		uint32_t tag = read_uint32(&reader);
+		if (!tag) {
 			break;
 		}
+		int64_t length = record_length(&reader, read_uint32(&reader));
+		size_t end = reader.pos + length;
+
+		if (length < 0 || end > reader.size) {
+			printf("Corrupted file.\n");
+			goto cleanup;
+		}
 		
 		if(tag == GCOV_TAG_FUNCTION){
-			auto identity = *read_uint32(notes_fd);
-			auto lineno_checksum = read_uint32(notes_fd);
-			
-			auto cfg_checksum = read_uint32(notes_fd); 
-			auto function_name = *read_string(notes_fd);
-
-			// printf("Function name: %s\n", function_name.c_str());
-			
-			auto artificial = read_uint32(notes_fd);
+			uint32_t identity = read_uint32(&reader);
+			uint32_t lineno_checksum = read_uint32(&reader);
+			uint32_t cfg_checksum = read_uint32(&reader);
+			std::string function_name = read_string(&reader);
+			uint32_t artificial = read_uint32(&reader);
 			// TODO: find_source
-			auto src_idx = read_string(notes_fd);
-			auto start_line = read_uint32(notes_fd);
-			auto start_column = read_uint32(notes_fd);
-			auto end_line = read_uint32(notes_fd);
-			auto end_column = read_uint32(notes_fd);
+			read_string(&reader);
+			uint32_t start_line = read_uint32(&reader);
+			uint32_t start_column = read_uint32(&reader);
+			uint32_t end_line = read_uint32(&reader);
+			uint32_t end_column = read_uint32(&reader);
+
+			if (fn) {
+				link_predecessors(arena, fn);
+			}
 
-			fn = new function_info_t;
+			fn = arena_array<function_info_t>(arena, 1);
 			functions->push_back(fn);
 			(*ident_to_fn)[identity] = fn;
 
-
-			fn->m_name = function_name;
+			char *name = arena_array<char>(arena, function_name.size() + 1);
+			function_name.copy(name, function_name.size());
+			fn->m_name = name;
 			fn->ident = identity;
-			fn->lineno_checksum = *lineno_checksum;
-			fn->cfg_checksum = *cfg_checksum;
-			// fn->src = (*src_idx).c_str();
-			fn->start_line = *start_line;
-			fn->start_column = *start_column;
-			fn->end_line = *end_line;
-			fn->end_column = *end_column;
-			fn->artificial = *artificial;
+			fn->lineno_checksum = lineno_checksum;
+			fn->cfg_checksum = cfg_checksum;
+			fn->start_line = start_line;
+			fn->start_column = start_column;
+			fn->end_line = end_line;
+			fn->end_column = end_column;
+			fn->artificial = artificial;
 
 			if (fn->artificial == true){
 				printf("This function is artificial!");
-//				return 1;
 			}
-	
+
+			// The arcs of all blocks in one go, their counters are
+			// allocated alongside once known
+			reader.pos = end;
+			arc_capacity = count_function_arcs(&reader);
+			fn->arc_src = arena_array<uint32_t>(arena, arc_capacity);
+			fn->arc_dst = arena_array<uint32_t>(arena, arc_capacity);
+			fn->arc_flags = arena_array<uint32_t>(arena, arc_capacity);
+			fn->arc_count = arena_array<int64_t>(arena, arc_capacity);
+			fn->arc_counter = arena_array<int32_t>(arena, arc_capacity);
+			fn->counts = arena_array<int64_t>(arena, arc_capacity);
+
 			current_tag = tag;
 		} else if(fn && tag == GCOV_TAG_BLOCKS) {
-			if (fn->blocks.empty() == true) {
-            	fn->blocks.resize(*read_uint32(notes_fd));
+			if (fn->num_blocks == 0) {
+				fn->num_blocks = read_uint32(&reader);
+				fn->blocks = arena_array<block_info>(arena, fn->num_blocks);
 			} else {
 				// TODO: Demangle function names
-				printf("Already seen blocks for %s in file %s\n", fn->m_name.c_str(), notes_file_name.c_str());
-				return 1;
+				printf("Already seen blocks for %s in file %s\n", fn->m_name, notes_file_name.c_str());
+				goto cleanup;
 			}
 		} else if(fn && tag == GCOV_TAG_ARCS) {
 
 			// Data entry describing arcs from a single basic block (src)
-			auto src = *read_uint32(notes_fd);
-			fn->blocks[src].id = src;
-			uint32_t num_dets = GCOV_TAG_ARCS_NUM(*length);
-			block_info* src_block = &fn->blocks[src];
+			uint32_t src = read_uint32(&reader);
+			uint32_t num_dests = (length / 4 - 1) / 2;
 
-			if (src >= fn->blocks.size() || src_block->succ){
+			if (src >= fn->num_blocks || fn->blocks[src].succ_end || fn->num_arcs + num_dests > arc_capacity){
 				printf("Corrupted file.\n");
-				return 1;
+				goto cleanup;
 			}
 
-			arc_info* arc;
+			block_info* src_block = &fn->blocks[src];
+			src_block->succ_begin = fn->num_arcs;
+
 			bool mark_catches = 0;
 
 			// Add all the outgoing destinations
-			for (;num_dets > 0; num_dets--){
-				auto dest = *read_uint32(notes_fd);
-				auto flags = *read_uint32(notes_fd);
+			for (;num_dests > 0; num_dests--){
+				uint32_t dest = read_uint32(&reader);
+				uint32_t flags = read_uint32(&reader);
 
-				if (dest >= fn->blocks.size ()){
+				if (dest >= fn->num_blocks){
 					printf("Dest > block size\n");
-					return 1;				
+					goto cleanup;
 				}
 
-				// Allocate arc
-				arc_info* arc = new arc_info;
-				fn->arcs.push_back(arc);
-
-				// Setup src and dst connections of arc
-				arc->src = src_block;
-				arc->dst = &fn->blocks[dest];
-				// printf("Dest: %li\n", dest);
-				arc->dst->id = dest;
-
-				// Initialize counts
+				uint32_t arc = fn->num_arcs++;
+				fn->arc_src[arc] = src;
+				fn->arc_dst[arc] = dest;
+				fn->arc_flags[arc] = flags & (GCOV_ARC_ON_TREE | GCOV_ARC_FAKE | GCOV_ARC_FALLTHROUGH);
 
-				arc->count = 0;
-				arc->count_valid = 0;
-				
-				arc->on_tree = !!(flags & GCOV_ARC_ON_TREE);
-				arc->fake = !!(flags & GCOV_ARC_FAKE);
-				arc->fall_through = !!(flags & GCOV_ARC_FALLTHROUGH);
-
-				arc->succ_next = src_block->succ;
-				src_block->succ = arc;
-				src_block->num_succ++;
-
-				arc->pred_next = fn->blocks[dest].pred;
-				fn->blocks[dest].pred = arc;
-				fn->blocks[dest].num_pred++;
-
-				if (arc->fake) {
+				if (flags & GCOV_ARC_FAKE) {
 					if (src) {
 						/* Exceptional exit from this function, the
 						source block must be a call.  */
-						fn->blocks[src].is_call_site = 1;
-						arc->is_call_non_return = 1;
+						src_block->is_call_site = 1;
+						fn->arc_flags[arc] |= ARC_CALL_NON_RETURN;
 						mark_catches = 1;
 					} else {
 						/* Non-local return from a callee of this
 						function.  The destination block is a setjmp.  */
-						arc->is_nonlocal_return = 1;
+						fn->arc_flags[arc] |= ARC_NONLOCAL_RETURN;
 						fn->blocks[dest].is_nonlocal_return = 1;
 					}
 				}
 
-				if (!arc->on_tree) {
-					fn->counts.push_back(0);
+				fn->arc_counter[arc] = NO_COUNTER;
+				if (!(flags & GCOV_ARC_ON_TREE)) {
+					fn->arc_counter[arc] = fn->num_counts++;
 				}
 			}
+			src_block->succ_end = fn->num_arcs;
 
 			if (mark_catches) {
 				/* We have a fake exit from this block.  The other
 				non-fall through exits must be to catch handlers.
 				Mark them as catch arcs.  */
 
-				for (arc = src_block->succ; arc; arc = arc->succ_next){
-					if (!arc->fake && !arc->fall_through) {
-						arc->is_throw = 1;
+				for (uint32_t arc = src_block->succ_begin; arc < src_block->succ_end; arc++){
+					if (!(fn->arc_flags[arc] & (GCOV_ARC_FAKE | GCOV_ARC_FALLTHROUGH))) {
+						fn->arc_flags[arc] |= ARC_IS_THROW;
 						fn->has_catch = 1;
 					}
 				}
 			}
 	
 		} else if (fn && tag == GCOV_TAG_LINES) {
-
 			// We don't care about the source code, only the basic blocks!
-
-			uint32_t blockno = *read_uint32(notes_fd);
-			// block_info *block = &fn->blocks[blockno];
-			if (blockno >= fn->blocks.size()) {
-				printf("More blocks than expected.\n");
-				return 1;
-			}
-
-			while (true) {
-				auto lineno = *read_uint32(notes_fd);
-				// printf("line no %i\n", lineno);
-
-				if (!lineno){
-					auto file_name = read_string(notes_fd);
-					if (file_name.has_value() == false){
-						break;
-					} else {
-						if (!((*file_name).c_str())) {
-							break;
-						}
-						// printf("file name: %s\n", file_name.value().c_str());
-					}
-				}
-			}
-
 		} else if (current_tag && !GCOV_TAG_IS_SUBTAG(current_tag, tag)) {
+			if (fn) {
+				link_predecessors(arena, fn);
+			}
 			fn = NULL;
 			current_tag = 0;
-		} else {
-
+		} else if (fn) {
 			printf("Unrecognised tag!\n");
-			return 0;
 		}
-		// fseek (notes_fd, base_pos, SEEK_SET);		
+
+		if (reader.error || reader.pos > end) {
+			printf("Corrupted file.\n");
+			goto cleanup;
+		}
+		reader.pos = end;
+	}
+
+	if (fn) {
+		link_predecessors(arena, fn);
 	}
+	result = 0;
 
-	fclose(notes_fd);
+cleanup:
+	unmap_file(&reader);
 
-	if (functions->empty()){
+	if (result == 0 && functions->empty()){
 		printf("%s:no functions found\n", notes_file_name.c_str());
 	}
 
-	return 0;
+	return result;
+}
+
+// Push block ix onto a solver chain
+static void push_block(function_info_t *fn, uint32_t *chain, uint32_t ix) {
+	fn->blocks[ix].chain = *chain;
+	*chain = ix;
 }
 
 /* Solve the flow graph. Propagate counts from the instrumented arcs
    to the blocks and the uninstrumented arcs.  */
 
 void solve_flow_graph(function_info_t *fn, std::string notes_file_name) {
-	uint32_t ix;
-	arc_info *arc;
-	int64_t *count_ptr = &fn->counts.front();
 	block_info *blk;
-	block_info *valid_blocks = NULL;   /* valid, but unpropagated blocks.  */
-	block_info *invalid_blocks = NULL; /* invalid, but inferable blocks.  */
-
-	/* The arcs were built in reverse order.  Fix that now.  */
-	for (ix = fn->blocks.size(); ix--;) {
-		arc_info *arc_p, *arc_n;
-
-		for (arc_p = NULL, arc = fn->blocks[ix].succ; arc; arc_p = arc, arc = arc_n) {
-			arc_n = arc->succ_next;
-			arc->succ_next = arc_p;
-		}
-		fn->blocks[ix].succ = arc_p;
-
-		for (arc_p = NULL, arc = fn->blocks[ix].pred; arc; arc_p = arc, arc = arc_n) {
-			arc_n = arc->pred_next;
-			arc->pred_next = arc_p;
-		}
-		fn->blocks[ix].pred = arc_p;
+	uint32_t valid_blocks = NO_BLOCK;   /* valid, but unpropagated blocks.  */
+	uint32_t invalid_blocks = NO_BLOCK; /* invalid, but inferable blocks.  */
+
+	/* The graph is kept across reads of the count file, so start from the
+	state read_notes_file left it in.  */
+	for (uint32_t ix = 0; ix < fn->num_blocks; ix++) {
+		blk = &fn->blocks[ix];
+		blk->num_succ = blk->succ_end - blk->succ_begin;
+		blk->num_pred = blk->pred_end - blk->pred_begin;
+		blk->count = 0;
+		blk->count_valid = 0;
+		blk->valid_chain = 0;
+		blk->invalid_chain = 0;
+		blk->chain = NO_BLOCK;
+	}
+	for (uint32_t arc = 0; arc < fn->num_arcs; arc++) {
+		fn->arc_count[arc] = 0;
+		fn->arc_flags[arc] &= ~ARC_COUNT_VALID;
 	}
 
-	if (fn->blocks.size() < 2){
-		printf("%s:'%s' lacks entry and/or exit blocks\n", notes_file_name.c_str(), fn->m_name.c_str());
+	if (fn->num_blocks < 2){
+		printf("%s:'%s' lacks entry and/or exit blocks\n", notes_file_name.c_str(), fn->m_name);
 	} else {
 		if (fn->blocks[ENTRY_BLOCK].num_pred)
-			printf("%s:'%s' has arcs to entry block\n", notes_file_name.c_str(), fn->m_name.c_str());
+			printf("%s:'%s' has arcs to entry block\n", notes_file_name.c_str(), fn->m_name);
 		else
 			/* We can't deduce the entry block counts from the lack of
 			predecessors.  */
 			fn->blocks[ENTRY_BLOCK].num_pred = ~(uint32_t)0;
 
 		if (fn->blocks[EXIT_BLOCK].num_succ)
-			printf("%s:'%s' has arcs from exit block\n", notes_file_name.c_str(), fn->m_name.c_str());
+			printf("%s:'%s' has arcs from exit block\n", notes_file_name.c_str(), fn->m_name);
 		else
 		/* Likewise, we can't deduce exit block counts from the lack
 		of its successors.  */
@@ -367,172 +504,131 @@ void solve_flow_graph(function_info_t *fn, std::string notes_file_name) {
 	}
 
 	/* Propagate the measured counts, this must be done in the same
-	order as the code in profile.cc  */
-	for (uint32_t i = 0; i < fn->blocks.size(); i++) {
-	blk = &fn->blocks[i];
-	block_info const *prev_dst = NULL;
-	int out_of_order = 0;
-	int non_fake_succ = 0;
-
-	for (arc = blk->succ; arc; arc = arc->succ_next) {
-		if (!arc->fake)
-			non_fake_succ++;
-
-		if (!arc->on_tree) {
-			if (count_ptr)
-				arc->count = *count_ptr++;
-			arc->count_valid = 1;
-			blk->num_succ--;
-			arc->dst->num_pred--;
-		}
-		if (prev_dst && prev_dst > arc->dst)
-			out_of_order = 1;
-		prev_dst = arc->dst;
-	}
-
-	if (non_fake_succ == 1) {
-		/* If there is only one non-fake exit, it is an
-		unconditional branch.  */
-		for (arc = blk->succ; arc; arc = arc->succ_next) {
-			if (!arc->fake) {
-				arc->is_unconditional = 1;
-				/* If this block is instrumenting a call, it might be
-				an artificial block. It is not artificial if it has
-				a non-fallthrough exit, or the destination of this
-				arc has more than one entry.  Mark the destination
-				block as a return site, if none of those conditions
-				hold.  */
-				if (blk->is_call_site && arc->fall_through && arc->dst->pred == arc && !arc->pred_next)
-					arc->dst->is_call_return = 1;
+	order as the code in profile.cc. gcov also sorts the successors by
+	destination here, which only matters for its output.  */
+	for (uint32_t ix = 0; ix < fn->num_blocks; ix++) {
+		blk = &fn->blocks[ix];
+		int non_fake_succ = 0;
+
+		for (uint32_t arc = blk->succ_begin; arc < blk->succ_end; arc++) {
+			if (!(fn->arc_flags[arc] & GCOV_ARC_FAKE))
+				non_fake_succ++;
+
+			if (fn->arc_counter[arc] != NO_COUNTER) {
+				fn->arc_count[arc] = fn->counts[fn->arc_counter[arc]];
+				fn->arc_flags[arc] |= ARC_COUNT_VALID;
+				blk->num_succ--;
+				fn->blocks[fn->arc_dst[arc]].num_pred--;
 			}
 		}
-	}
 
-	/* Sort the successor arcs into ascending dst order. profile.cc
-	normally produces arcs in the right order, but sometimes with
-	one or two out of order.  We're not using a particularly
-	smart sort.  */
-	if (out_of_order) {
-		arc_info *start = blk->succ;
-		uint32_t changes = 1;
-
-		while (changes) {
-			arc_info *arc, *arc_p, *arc_n;
-
-			changes = 0;
-			for (arc_p = NULL, arc = start; (arc_n = arc->succ_next);) {
-				if (arc->dst > arc_n->dst) {
-					changes = 1;
-					if (arc_p)
-						arc_p->succ_next = arc_n;
-					else
-						start = arc_n;
-
-					arc->succ_next = arc_n->succ_next;
-					arc_n->succ_next = arc;
-					arc_p = arc_n;
-				} else {
-					arc_p = arc;
-					arc = arc_n;
+		if (non_fake_succ == 1) {
+			/* If there is only one non-fake exit, it is an
+			unconditional branch.  */
+			for (uint32_t arc = blk->succ_begin; arc < blk->succ_end; arc++) {
+				if (!(fn->arc_flags[arc] & GCOV_ARC_FAKE)) {
+					fn->arc_flags[arc] |= ARC_UNCONDITIONAL;
+					/* If this block is instrumenting a call, it might be
+					an artificial block. It is not artificial if it has
+					a non-fallthrough exit, or the destination of this
+					arc has more than one entry.  Mark the destination
+					block as a return site, if none of those conditions
+					hold.  */
+					block_info *dst = &fn->blocks[fn->arc_dst[arc]];
+					if (blk->is_call_site && (fn->arc_flags[arc] & GCOV_ARC_FALLTHROUGH) && dst->pred_end - dst->pred_begin == 1)
+						dst->is_call_return = 1;
 				}
 			}
 		}
-		blk->succ = start;
-	}
 
-	/* Place it on the invalid chain, it will be ignored if that's
-	wrong.  */
-	blk->invalid_chain = 1;
-	blk->chain = invalid_blocks;
-	invalid_blocks = blk;
+		/* Place it on the invalid chain, it will be ignored if that's
+		wrong.  */
+		blk->invalid_chain = 1;
+		push_block(fn, &invalid_blocks, ix);
 	}
 
-	while (invalid_blocks || valid_blocks) {
-		while ((blk = invalid_blocks)) {
+	while (invalid_blocks != NO_BLOCK || valid_blocks != NO_BLOCK) {
+		while (invalid_blocks != NO_BLOCK) {
+			uint32_t ix = invalid_blocks;
 			int64_t total = 0;
-			const arc_info *arc;
 
+			blk = &fn->blocks[ix];
 			invalid_blocks = blk->chain;
 			blk->invalid_chain = 0;
 
 			if (!blk->num_succ)
-				for (arc = blk->succ; arc; arc = arc->succ_next)
-					total += arc->count;
+				for (uint32_t arc = blk->succ_begin; arc < blk->succ_end; arc++)
+					total += fn->arc_count[arc];
 			else if (!blk->num_pred)
-				for (arc = blk->pred; arc; arc = arc->pred_next)
-					total += arc->count;
+				for (uint32_t pred = blk->pred_begin; pred < blk->pred_end; pred++)
+					total += fn->arc_count[fn->pred_arcs[pred]];
 			else
 				continue;
 
 			blk->count = total;
 			blk->count_valid = 1;
-			blk->chain = valid_blocks;
 			blk->valid_chain = 1;
-			valid_blocks = blk;
+			push_block(fn, &valid_blocks, ix);
 		}
-		while ((blk = valid_blocks)) {
+		while (valid_blocks != NO_BLOCK) {
 			int64_t total;
-			arc_info *arc, *inv_arc;
+			uint32_t inv_arc;
 
+			blk = &fn->blocks[valid_blocks];
 			valid_blocks = blk->chain;
 			blk->valid_chain = 0;
 			if (blk->num_succ == 1) {
-					block_info *dst;
-
 				total = blk->count;
-				inv_arc = NULL;
-				for (arc = blk->succ; arc; arc = arc->succ_next) {
-					total -= arc->count;
-				if (!arc->count_valid)
-					inv_arc = arc;
+				inv_arc = 0;
+				for (uint32_t arc = blk->succ_begin; arc < blk->succ_end; arc++) {
+					total -= fn->arc_count[arc];
+					if (!(fn->arc_flags[arc] & ARC_COUNT_VALID))
+						inv_arc = arc;
 				}
-				dst = inv_arc->dst;
-				inv_arc->count_valid = 1;
-				inv_arc->count = total;
+				uint32_t dst_ix = fn->arc_dst[inv_arc];
+				block_info *dst = &fn->blocks[dst_ix];
+				fn->arc_flags[inv_arc] |= ARC_COUNT_VALID;
+				fn->arc_count[inv_arc] = total;
 				blk->num_succ--;
 				dst->num_pred--;
 				if (dst->count_valid) {
 					if (dst->num_pred == 1 && !dst->valid_chain) {
-						dst->chain = valid_blocks;
 						dst->valid_chain = 1;
-						valid_blocks = dst;
+						push_block(fn, &valid_blocks, dst_ix);
 					}
 				} else {
 					if (!dst->num_pred && !dst->invalid_chain) {
-						dst->chain = invalid_blocks;
 						dst->invalid_chain = 1;
-						invalid_blocks = dst;
+						push_block(fn, &invalid_blocks, dst_ix);
 					}
 				}
 			}
 
 			if (blk->num_pred == 1) {
-				block_info *src;
-
 				total = blk->count;
-				inv_arc = NULL;
+				inv_arc = 0;
 
-				for (arc = blk->pred; arc; arc = arc->pred_next) {
-					total -= arc->count;
-					if (!arc->count_valid)
+				for (uint32_t pred = blk->pred_begin; pred < blk->pred_end; pred++) {
+					uint32_t arc = fn->pred_arcs[pred];
+					total -= fn->arc_count[arc];
+					if (!(fn->arc_flags[arc] & ARC_COUNT_VALID))
 						inv_arc = arc;
 				}
-				src = inv_arc->src;
-				inv_arc->count_valid = 1;
-				inv_arc->count = total;
+				uint32_t src_ix = fn->arc_src[inv_arc];
+				block_info *src = &fn->blocks[src_ix];
+				fn->arc_flags[inv_arc] |= ARC_COUNT_VALID;
+				fn->arc_count[inv_arc] = total;
 				blk->num_pred--;
 				src->num_succ--;
 				if (src->count_valid) {
 					if (src->num_succ == 1 && !src->valid_chain) {
-					src->chain = valid_blocks;
-					src->valid_chain = 1;
-					valid_blocks = src;
+						src->valid_chain = 1;
+						push_block(fn, &valid_blocks, src_ix);
 					}
 				} else {
 					if (!src->num_succ && !src->invalid_chain) {
-					src->chain = invalid_blocks;
-					src->invalid_chain = 1;
-					invalid_blocks = src;
+						src->invalid_chain = 1;
+						push_block(fn, &invalid_blocks, src_ix);
 					}
 				}
 			}
@@ -541,9 +637,9 @@ void solve_flow_graph(function_info_t *fn, std::string notes_file_name) {
 
 	/* If the graph has been correctly solved, every block will have a
 	valid count.  */
-	for (uint32_t i = 0; ix < fn->blocks.size(); i++)
-	if (!fn->blocks[i].count_valid) {
-		printf("%s:graph is unsolvable\n", fn->m_name.c_str());
+	for (uint32_t ix = 0; ix < fn->num_blocks; ix++)
+	if (!fn->blocks[ix].count_valid) {
+		printf("%s:graph is unsolvable\n", fn->m_name);
 		break;
 	}
 }
@@ -551,116 +647,263 @@ void solve_flow_graph(function_info_t *fn, std::string notes_file_name) {
 
 
 int read_count_file(std::string count_file_name, std::map<uint32_t, function_info_t *>* ident_to_fn) {
-	uint32_t ix;
 
-	FILE* count_fd = fopen(count_file_name.c_str(), "rb");
-	if (!count_fd) {
+	int count_fd = open(count_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (count_fd < 0) {
 		printf("%s:cannot open data file, assuming not executed\n",count_file_name.c_str());
 		return 0;
 	}
 
-	if(auto magic = read_uint32(count_fd)) {
-		if (*magic != GCOV_DATA_MAGIC){
-			printf("%s is note a gcov note file. Header is %x, expected %x\n", count_file_name.c_str(), *magic, GCOV_NOTE_MAGIC);
-			return 1;
-		}
-	} else {
+	// libgcov holds a write lock while it merges the counters of an exiting
+	// SUT, which may be running while the previous one is analysed. The lock
+	// is held until the file is unmapped again.
+	struct flock lock = {};
+	lock.l_type = F_RDLCK;
+	lock.l_whence = SEEK_SET;
+	fcntl(count_fd, F_SETLKW, &lock);
+
+	gcov_reader reader;
+	if (!map_file(&reader, count_fd)) {
+		printf("Could not map %s\n", count_file_name.c_str());
+		close(count_fd);
 		return 1;
 	}
 
-	auto version __attribute__((unused)) = *read_uint32(count_fd);
-	auto tag = *read_uint32(count_fd);
-	// if (tag != bbg_stamp) {
-	// 	fnotice(stderr, "%s:stamp mismatch with notes file\n", count_file_name);
-	// 	return_code = 5;
-	// 	goto cleanup;
-	// }
-
-	/* Read checksum.  */
-	// read_uint32(count_fd);
-
+	int result = 1;
 	function_info_t *fn = NULL;
-	std::map<uint32_t, function_info_t *>::iterator it;
-
-	while ((tag = *read_uint32(count_fd))) {
-		auto length = *read_uint32(count_fd);
-		int read_length = (int)length;
-		auto base __attribute__((unused)) = ftell(count_fd);
 
-		// printf("Tag: %x\n", tag);
+	if (!read_header(&reader, count_file_name, GCOV_DATA_MAGIC)) {
+		goto cleanup;
+	}
 
-		if (feof(count_fd)) {
-			// printf("Reached EOF\n");
+	while (reader.pos + 8 <= reader.size) {
+		uint32_t tag = read_uint32(&reader);
+		if (!tag) {
 			break;
 		}
+		int64_t length = record_length(&reader, read_uint32(&reader));
+		// All-zero counters have no data
+		size_t end = reader.pos + (length > 0 ? length : 0);
+
+		if (end > reader.size) {
+			printf("%s:corrupted\n", count_file_name.c_str());
+			goto cleanup;
+		}
 
 		if (tag == GCOV_TAG_OBJECT_SUMMARY) {
-			gcov_summary summary __attribute__((unused));
-			summary.runs = *read_uint32(count_fd);
-			summary.sum_max = *read_uint32(count_fd);
-			// object_runs = summary.runs;
+			// Runs and sum_max, not used
 		} else if (tag == GCOV_TAG_FUNCTION && !length){
-			// printf("Function tag no length\n");
 			; /* placeholder  */
-		}
-		else if (tag == GCOV_TAG_FUNCTION && length == GCOV_TAG_FUNCTION_LENGTH) {
-			uint32_t ident = *read_uint32(count_fd);
-			fn = NULL;
-			it = ident_to_fn->find(ident);
-			if (it != ident_to_fn->end())
-				fn = it->second;
-
-			if (!fn)
-				;
-			else if (*read_uint32(count_fd) != fn->lineno_checksum || *read_uint32(count_fd) != fn->cfg_checksum) {
-				printf("%s:profile mismatch for '%s'\n", count_file_name.c_str(), fn->m_name.c_str());
-				return 1;
+		} else if (tag == GCOV_TAG_FUNCTION && length == GCOV_TAG_FUNCTION_LENGTH * 4) {
+			uint32_t ident = read_uint32(&reader);
+			auto it = ident_to_fn->find(ident);
+			fn = it != ident_to_fn->end() ? it->second : NULL;
+
+			uint32_t lineno_checksum = read_uint32(&reader);
+			uint32_t cfg_checksum = read_uint32(&reader);
+			if (fn && (lineno_checksum != fn->lineno_checksum || cfg_checksum != fn->cfg_checksum)) {
+				printf("%s:profile mismatch for '%s'\n", count_file_name.c_str(), fn->m_name);
+				goto cleanup;
 			}
 		} else if (tag == GCOV_TAG_FOR_COUNTER(GCOV_COUNTER_ARCS) && fn) {
-			length = abs(read_length);
-			
-			if (length != GCOV_TAG_COUNTER_LENGTH(fn->counts.size())){
+			if ((size_t) llabs(length) != fn->num_counts * 8){
 				printf("Length does not match\n");
-				return 1;
+				goto cleanup;
 			}
 
-			if (read_length > 0){
-				for (ix = 0; ix != fn->counts.size(); ix++){
+			if (length > 0) {
+				add_counters(fn->counts, reader.data + reader.pos, fn->num_counts);
+			}
+		} else if (GCOV_TAG_IS_COUNTER(tag)) {
+			// Value profiles and counters of unknown functions
+		} else {
+			printf("Unrecognised tag!\n");
+			goto cleanup;
+		}
 
-					int64_t value;
-					uint32_t allocated_buffer[2];
-					uint32_t *buffer = (uint32_t*)*read_bytes(count_fd, &allocated_buffer, 2 * 4);
+		if (reader.error) {
+			printf("%s:corrupted\n", count_file_name.c_str());
+			goto cleanup;
+		}
+		reader.pos = end;
+	}
 
-					if (!buffer)
-						value = 0;
+	result = 0;
 
-					value = buffer[0];
-					// if (sizeof (value) > sizeof (gcov_uint32_t_t))
-					value |= ((int64_t) buffer[1]) << 32;
-					// else if (buffer[1])
-						// gcov_var.error = GCOV_FILE_COUNTER_OVERFLOW;
+cleanup:
+	unmap_file(&reader);
+	close(count_fd);
+	return result;
+}
 
+// Header words before the first record
+static size_t header_size(const gcov_reader *reader) {
+	return reader->bytes ? 16 : 12;
+}
 
-					fn->counts[ix] += value;
-					// printf("Read counts %lu \n", fn->counts[ix]);
-				}
+// Arc counter records and the object summary of a mapped count file. Calls
+// record for every record, with the ident of the function it belongs to.
+// Returns false if the file is corrupted.
+template <typename Record>
+static bool walk_count_file(gcov_reader *reader, Record record) {
+	if (read_uint32(reader) != GCOV_DATA_MAGIC) {
+		return false;
+	}
+	reader->bytes = gcc_major(read_uint32(reader)) >= 12;
+	reader->pos = header_size(reader);
+
+	uint32_t ident = 0;
+	bool in_function = false;
+	while (reader->pos + 8 <= reader->size) {
+		size_t start = reader->pos;
+		uint32_t tag = read_uint32(reader);
+		if (!tag) {
+			break;
+		}
+		int64_t length = record_length(reader, read_uint32(reader));
+		size_t end = reader->pos + (length > 0 ? length : 0);
+		if (end > reader->size) {
+			return false;
+		}
+
+		if (tag == GCOV_TAG_FUNCTION) {
+			in_function = length == GCOV_TAG_FUNCTION_LENGTH * 4;
+			ident = in_function ? read_uint32(reader) : 0;
+		}
+		record(tag, length, in_function ? &ident : NULL, start, end);
+		reader->pos = end;
+	}
+	return !reader->error;
+}
+
+// Arc counters of one record, zero for a record with a negative length
+static std::vector<int64_t> record_counters(const gcov_reader *reader, int64_t length, size_t start) {
+	std::vector<int64_t> counters(llabs(length) / 8, 0);
+	if (length > 0) {
+		add_counters(counters.data(), reader->data + start + 8, counters.size());
+	}
+	return counters;
+}
+
+bool read_arc_counters(std::string count_file_name, gcda_counts* counts) {
+	counts->arcs.clear();
+	counts->runs = 0;
+
+	int fd = open(count_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct flock lock = {};
+	lock.l_type = F_RDLCK;
+	lock.l_whence = SEEK_SET;
+	fcntl(fd, F_SETLKW, &lock);
+
+	gcov_reader reader;
+	bool read = map_file(&reader, fd) && reader.size > 0;
+	if (read) {
+		read = walk_count_file(&reader, [&](uint32_t tag, int64_t length, const uint32_t *ident, size_t start, size_t) {
+			if (tag == GCOV_TAG_FOR_COUNTER(GCOV_COUNTER_ARCS) && ident) {
+				counts->arcs[*ident] = record_counters(&reader, length, start);
+			} else if (tag == GCOV_TAG_OBJECT_SUMMARY && length >= 4) {
+				memcpy(&counts->runs, reader.data + start + 8, 4);
 			}
+		});
+	}
 
-			if (read_length < 0)
-				read_length = 0;
-			
-			// gcov_sync(base, read_length);
-			// if ((error = gcov_is_error())) {
-			// 	fnotice(stderr, error < 0 ? N_("%s:overflowed\n") : N_("%s:corrupted\n"), count_file_name);
-			// 	return_code = 4;
-			// 	goto cleanup;
-			// }
-		} else {
-			printf("Unrecognised tag!\n");
-			return 1;
+	unmap_file(&reader);
+	close(fd);
+	return read;
+}
+
+static std::vector<uint8_t> read_whole(int fd) {
+	std::vector<uint8_t> content;
+	uint8_t buffer[65536];
+	ssize_t bytes;
+	while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+		content.insert(content.end(), buffer, buffer + bytes);
+	}
+	return content;
+}
+
+static void append_uint32(std::vector<uint8_t> *out, uint32_t value) {
+	out->insert(out->end(), (uint8_t *) &value, (uint8_t *) &value + 4);
+}
+
+bool add_arc_counters(std::string count_file_name, std::string template_file_name, const gcda_counts* counts) {
+	int fd = open(count_file_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	struct flock lock = {};
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+	fcntl(fd, F_SETLKW, &lock);
+
+	std::vector<uint8_t> content = read_whole(fd);
+	bool created = content.empty();
+	if (created) {
+		int template_fd = open(template_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+		if (template_fd >= 0) {
+			struct flock template_lock = {};
+			template_lock.l_type = F_RDLCK;
+			template_lock.l_whence = SEEK_SET;
+			fcntl(template_fd, F_SETLKW, &template_lock);
+			content = read_whole(template_fd);
+			close(template_fd);
 		}
+		// The template's own counters are not part of counts
+		gcov_reader reader = {content.data(), content.size(), 0, false, false};
+		std::vector<std::pair<size_t, size_t>> zero;
+		walk_count_file(&reader, [&](uint32_t tag, int64_t length, const uint32_t *ident, size_t start, size_t end) {
+			if ((tag == GCOV_TAG_FOR_COUNTER(GCOV_COUNTER_ARCS) && ident && length > 0) || tag == GCOV_TAG_OBJECT_SUMMARY) {
+				zero.push_back({start + 8, end});
+			}
+		});
+		for (auto &range : zero) {
+			std::fill(content.begin() + range.first, content.begin() + range.second, 0);
+		}
+	}
+
+	gcov_reader reader = {content.data(), content.size(), 0, false, false};
+	std::vector<uint8_t> merged;
+	size_t copied = 0;
+	bool walked = content.size() > 0 && walk_count_file(&reader, [&](uint32_t tag, int64_t length, const uint32_t *ident, size_t start, size_t end) {
+		if (tag == GCOV_TAG_OBJECT_SUMMARY && length >= 4) {
+			uint32_t runs;
+			memcpy(&runs, content.data() + start + 8, 4);
+			runs += counts->runs;
+			memcpy(content.data() + start + 8, &runs, 4);
+			return;
+		}
+		if (tag != GCOV_TAG_FOR_COUNTER(GCOV_COUNTER_ARCS) || !ident) {
+			return;
+		}
+		auto added = counts->arcs.find(*ident);
+		std::vector<int64_t> counters = record_counters(&reader, length, start);
+		if (added == counts->arcs.end() || added->second.size() != counters.size()) {
+			return;
+		}
+
+		// Rewritten with its counters, which may no longer be all zero
+		merged.insert(merged.end(), content.begin() + copied, content.begin() + start);
+		append_uint32(&merged, tag);
+		append_uint32(&merged, reader.bytes ? counters.size() * 8 : counters.size() * 2);
+		for (size_t i = 0; i < counters.size(); i++) {
+			uint64_t value = counters[i] + added->second[i];
+			append_uint32(&merged, (uint32_t) value);
+			append_uint32(&merged, (uint32_t) (value >> 32));
+		}
+		copied = end;
+	});
+	if (walked) {
+		merged.insert(merged.end(), content.begin() + copied, content.end());
+		walked = pwrite(fd, merged.data(), merged.size(), 0) == (ssize_t) merged.size() && ftruncate(fd, merged.size()) == 0;
+	}
+	// An empty count file is not one libgcov can merge into
+	if (!walked && created) {
+		unlink(count_file_name.c_str());
 	}
 
-	fclose(count_fd);
-	return 0;
+	close(fd);
+	return walked;
 }
@@ -43,6 +43,7 @@
 #define GCOV_TAG_AFDO_WORKING_SET (0xaf000000)
 
 #define GCOV_COUNTER_ARCS       0  /* Arc transitions.  */
+#define GCOV_COUNTERS           8  /* Arcs and the value profilers.  */
 
 /* Convert a counter index to a tag.  */
 #define GCOV_TAG_FOR_COUNTER(COUNT)				\
@@ -76,73 +77,57 @@
 #define GCOV_ARC_FAKE		(1 << 1)
 #define GCOV_ARC_FALLTHROUGH	(1 << 2)
 
-struct arc_info {
-  /* source and destination blocks.  */
-  struct block_info *src;
-  struct block_info *dst;
+/* Flags derived while reading and solving the graph, kept with the
+   GCOV_ARC_* flags from the notes file.  */
+#define ARC_COUNT_VALID		(1 << 3)
+#define ARC_IS_THROW		(1 << 4)	/* Arc to a catch handler.  */
+#define ARC_CALL_NON_RETURN	(1 << 5)	/* Arc is for a function that abnormally returns.  */
+#define ARC_NONLOCAL_RETURN	(1 << 6)	/* Arc is for catch/setjmp.  */
+#define ARC_UNCONDITIONAL	(1 << 7)	/* Is an unconditional branch.  */
 
-  /* transition counts.  */
-  int64_t count;
-  /* used in cycle search, so that we do not clobber original counts.  */
-  int64_t cs_count;
-
-  uint32_t count_valid : 1;
-  uint32_t on_tree : 1;
-  uint32_t fake : 1;
-  uint32_t fall_through : 1;
-
-  /* Arc to a catch handler.  */
-  uint32_t is_throw : 1;
-
-  /* Arc is for a function that abnormally returns.  */
-  uint32_t is_call_non_return : 1;
+/* No block, ends a chain.  */
+#define NO_BLOCK (~(uint32_t)0)
 
-  /* Arc is for catch/setjmp.  */
-  uint32_t is_nonlocal_return : 1;
-
-  /* Is an unconditional branch.  */
-  uint32_t is_unconditional : 1;
-
-  /* Loop making arc.  */
-  uint32_t cycle : 1;
-
-  /* Links to next arc on src and dst lists.  */
-  arc_info *succ_next;
-  arc_info *pred_next;
-};
+/* No counter, the arc is on the spanning tree.  */
+#define NO_COUNTER (-1)
 
-
-/* Describes which locations (lines and files) are associated with
-   a basic block.  */
-
-class block_location_info {
-public:
-  block_location_info(unsigned _source_file_idx)
-      : source_file_idx(_source_file_idx) {}
-
-  unsigned source_file_idx;
-  std::vector<unsigned> lines;
-};
-
-/* Describes a basic block. Contains lists of arcs to successor and
-   predecessor blocks.  */
+/*
+	The graphs of one notes file are allocated from a single bump arena and
+	freed with it. None of the structures below own memory of their own.
+*/
+typedef struct {
+	std::vector<char *> chunks;
+	// Free space in the last chunk
+	char *next;
+	size_t left;
+} gcov_arena;
+
+// Zeroed memory, valid until the arena is freed
+void *arena_alloc(gcov_arena *arena, size_t size, size_t align);
+template <typename T>
+T *arena_array(gcov_arena *arena, size_t count) {
+	return (T *) arena_alloc(arena, sizeof(T) * count, alignof(T));
+}
+void arena_free(gcov_arena *arena);
+
+/* Describes a basic block. Its exit arcs are arcs [succ_begin, succ_end)
+   of its function, its entry arcs are listed in pred_arcs[pred_begin,
+   pred_end).  */
 struct block_info {
-  /* Chain of exit and entry arcs.  */
-  arc_info *succ;
-  arc_info *pred;
+  uint32_t succ_begin;
+  uint32_t succ_end;
+  uint32_t pred_begin;
+  uint32_t pred_end;
 
   /* Number of unprocessed exit and entry arcs.  */
   int64_t num_succ;
   int64_t num_pred;
 
-  unsigned id;
-
   /* Block execution count.  */
   int64_t count;
   uint32_t count_valid : 1;
   uint32_t valid_chain : 1;
   uint32_t invalid_chain : 1;
-  uint32_t exceptional : 1;
 
   /* Block is a call instrumenting site.  */
   uint32_t is_call_site : 1;   /* Does the call.  */
@@ -151,52 +136,14 @@ struct block_info {
   /* Block is a landing pad for longjmp or throw.  */
   uint32_t is_nonlocal_return : 1;
 
-  std::vector<block_location_info> locations;
-
-  struct {
-    /* Single line graph cycle workspace.  Used for all-blocks
-       mode.  */
-    arc_info *arc;
-    unsigned ident;
-  } cycle; /* Used in all-blocks mode, after blocks are linked onto
-             lines.  */
-
-  /* Temporary chain for solving graph, and for chaining blocks on one
-     line.  */
-  struct block_info *chain;
-};
-
-/* Describes which locations (lines and files) are associated with
-   a basic block.  */
-
-class line_info {
-public:
-  /* Default constructor.  */
-  line_info();
-
-  /* Return true when NEEDLE is one of basic blocks the line belongs to.  */
-  bool has_block(block_info *needle);
-
-  /* Execution count.  */
-  int64_t count;
-
-  /* Branches from blocks that end on this line.  */
-  std::vector<arc_info *> branches;
-
-  /* blocks which start on this line.  Used in all-blocks mode.  */
-  std::vector<block_info *> blocks;
-
-  uint32_t exists : 1;
-  uint32_t unexceptional : 1;
-  uint32_t has_unexecuted_block : 1;
+  /* Temporary chain for solving graph.  */
+  uint32_t chain;
 };
 
-
 struct function_info_t {
 	
 	/* Name of function.  */
-	std::string m_name;
-	char *m_demangled_name;
+	const char *m_name;
 	uint32_t ident;
 	uint32_t lineno_checksum;
 	uint32_t cfg_checksum;
@@ -208,21 +155,30 @@ struct function_info_t {
 	 in a source file.  */
 	uint32_t artificial : 1;
 
-	/* True when multiple functions start at a line in a source file.  */
-	uint32_t is_group : 1;
-
 	/* Array of basic blocks.  Like in GCC, the entry block is
 	 at blocks[0] and the exit block is at blocks[1].  */
 	#define ENTRY_BLOCK (0)
 	#define EXIT_BLOCK (1)
-	std::vector<struct block_info> blocks;
-	uint32_t blocks_executed;
-
-	/* Raw arc coverage counts.  */
-	std::vector<int64_t> counts;
-
-	/* All arcs in function  */
-	std::vector<arc_info*> arcs;
+	uint32_t num_blocks;
+	block_info *blocks;
+
+	/* The arcs, as parallel arrays in notes file order, so grouped by
+	 source block.  */
+	uint32_t num_arcs;
+	uint32_t *arc_src;
+	uint32_t *arc_dst;
+	uint32_t *arc_flags;
+	/* Transition counts, once solved.  */
+	int64_t *arc_count;
+	/* Index of the arc's counter in counts, or NO_COUNTER.  */
+	int32_t *arc_counter;
+
+	/* Entry arcs of every block, see block_info.  */
+	uint32_t *pred_arcs;
+
+	/* Raw arc coverage counts, one per arc off the spanning tree.  */
+	uint32_t num_counts;
+	int64_t *counts;
 
 	/* First line number.  */
 	uint32_t start_line;
@@ -235,15 +191,6 @@ struct function_info_t {
 
 	/* Last line column.  */
 	uint32_t end_column;
-
-	/* Index of source file where the function is defined.  */
-	uint32_t src;
-
-	/* Vector of line information (used only for group functions).  */
-	std::vector<line_info> lines;
-
-	/* Next function.  */
-	function_info_t *next;
 };
 
 /* Object & program summary record.  */
@@ -256,7 +203,23 @@ struct gcov_summary
 
 
 int read_count_file(std::string count_file_name, std::map<uint32_t, function_info_t *>* ident_to_fn);
-int read_notes_file(std::string notes_file_name, std::vector<function_info_t*>* functions, std::map<uint32_t, function_info_t *>* ident_to_fn);
+
+/* Arc counters of a count file by function ident, and its number of runs.  */
+typedef struct {
+	std::map<uint32_t, std::vector<int64_t>> arcs;
+	uint32_t runs;
+} gcda_counts;
+
+/* Read the arc counters of a count file without a graph to read them into.
+   Returns false if the file is missing or cannot be read.  */
+bool read_arc_counters(std::string count_file_name, gcda_counts* counts);
+
+/* Add counts to the arc counters of a count file, under the lock libgcov
+   takes as well. Every record is kept where it is, as libgcov only merges
+   into a file laid out as it would write it. A missing file is created from
+   template_file_name, a count file of the same object.  */
+bool add_arc_counters(std::string count_file_name, std::string template_file_name, const gcda_counts* counts);
+int read_notes_file(std::string notes_file_name, gcov_arena* arena, std::vector<function_info_t*>* functions, std::map<uint32_t, function_info_t *>* ident_to_fn);
 void solve_flow_graph(function_info_t *fn, std::string notes_file_name);
 
 
@@ -154,6 +154,19 @@ std::string generate_strategy_8_unsat_pigeon_much_more_than_hole(std::mt19937 ge
     return generate_unsat_pigeonhole(num_pigeons, num_pigeons/2); 
 }
 
+// ======== GENERATION STRATEGY #9 ========
+// Takes a file of the seed corpus as is, for the mutation strategies to work on
+std::string generate_strategy_9_seed_corpus(std::mt19937 generator, int seed, float aggresiveness, seed_corpus *corpus)
+{
+    std::string_view seed_file = corpus ? corpus_pick(corpus, generator) : std::string_view();
+
+    // Nothing to start from
+    if (seed_file.empty())
+        return generate_strategy_3_cnf(generator, seed, aggresiveness);
+
+    return std::string(seed_file);
+}
+
 // ===================================== 
 // ======== MUTATION STRATEGIES ======== 
 // ===================================== 
@@ -600,7 +613,7 @@ std::string mutate_strategy_15_controlled_chaos(std::string cnf_input, int seed,
 }
 
 
-std::string generate_new_input(int seed, const Strategy *strat, bool verbose = false)
+std::string generate_new_input(int seed, const Strategy *strat, bool verbose, seed_corpus *corpus)
 {   
 
     // Get command from top level 
@@ -649,11 +662,24 @@ std::string generate_new_input(int seed, const Strategy *strat, bool verbose = f
         case choose_generate_strategy_8_unsat_pigeon_much_more_than_hole: 
             cnf_file = generate_strategy_8_unsat_pigeon_much_more_than_hole(generator, gen_aggresiveness); 
             break; 
+        case choose_generate_strategy_9_seed_corpus: 
+            cnf_file = generate_strategy_9_seed_corpus(generator, seed, gen_aggresiveness, corpus); 
+            break; 
+        // The queue is the fuzzer's, this only runs while it is empty
+        case choose_generate_strategy_10_queue: 
         default:
             cnf_file = generate_strategy_3_cnf(generator, seed, gen_aggresiveness); 
             break; 
     }
 
+    return mutate_input(cnf_file, seed, strat); 
+}
+
+std::string mutate_input(std::string cnf_file, int seed, const Strategy *strat)
+{
+    mutation_strategy_t mutation_strategy = strat->mut_strat;
+    float mut_aggresiveness = strat->mut_aggresiveness; 
+
     // Choose mutation strategy 
     switch (mutation_strategy)
     {
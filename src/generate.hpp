@@ -6,6 +6,8 @@
 #include <string>
 #include <tuple>
 
+#include "corpus.hpp"
+
 // Enumeration of generation strategies 
 enum generation_strategy_t
 {
@@ -17,6 +19,8 @@ enum generation_strategy_t
     choose_generate_strategy_6_unsat_combination,
     choose_generate_strategy_7_unsat_pigeonhole, 
     choose_generate_strategy_8_unsat_pigeon_much_more_than_hole,
+    choose_generate_strategy_9_seed_corpus,
+    choose_generate_strategy_10_queue,
 
     choose_generate_strategy_end,
 }; 
@@ -51,6 +55,11 @@ typedef struct
   float mut_aggresiveness;
 } Strategy;
 
-std::string generate_new_input(int seed, const Strategy *strat, bool verbose);
+// Seeds for choose_generate_strategy_9_seed_corpus come from corpus, which
+// may be NULL or empty, in which case a cnf is generated instead
+std::string generate_new_input(int seed, const Strategy *strat, bool verbose, seed_corpus *corpus = NULL);
+
+// Apply the mutation strategy of strat to input
+std::string mutate_input(std::string input, int seed, const Strategy *strat);
 
 #endif
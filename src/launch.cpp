@@ -0,0 +1,370 @@
+#include "launch.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SCRIPT_DIR_BRACED "${SCRIPT_DIR}/"
+#define SCRIPT_DIR_PLAIN "$SCRIPT_DIR/"
+
+#define OUTPUT_CHUNK 65536
+
+// How often the child is checked on without a pidfd to poll
+#define EXIT_POLL_MS 5
+
+void output_init(OutputBuffer *output, size_t cap) {
+	output->cap = cap;
+	output->data.reserve(cap - cap / 2);
+	output->tail.reserve(cap / 2);
+	output_clear(output);
+}
+
+void output_clear(OutputBuffer *output) {
+	output->data.clear();
+	output->tail.clear();
+	output->tail_start = 0;
+	output->dropped = 0;
+}
+
+void output_append(OutputBuffer *output, const char *bytes, size_t count) {
+	size_t head_cap = output->cap - output->cap / 2;
+	size_t tail_cap = output->cap / 2;
+
+	size_t to_head = std::min(count, head_cap - std::min(head_cap, output->data.size()));
+	output->data.append(bytes, to_head);
+	bytes += to_head;
+	count -= to_head;
+
+	if (count == 0 || tail_cap == 0) {
+		output->dropped += count;
+		return;
+	}
+
+	// Only the last tail_cap bytes can survive
+	if (count > tail_cap) {
+		output->dropped += count - tail_cap;
+		bytes += count - tail_cap;
+		count = tail_cap;
+	}
+
+	size_t to_fill = std::min(count, tail_cap - output->tail.size());
+	output->tail.append(bytes, to_fill);
+	bytes += to_fill;
+	count -= to_fill;
+
+	// The ring is full, overwrite the oldest bytes
+	while (count > 0) {
+		size_t run = std::min(count, tail_cap - output->tail_start);
+		memcpy(&output->tail[output->tail_start], bytes, run);
+		output->tail_start = (output->tail_start + run) % tail_cap;
+		output->dropped += run;
+		bytes += run;
+		count -= run;
+	}
+}
+
+bool output_drain(int fd, OutputBuffer *output) {
+	char chunk[OUTPUT_CHUNK];
+
+	while (true) {
+		ssize_t count = read(fd, chunk, sizeof(chunk));
+		if (count > 0) {
+			output_append(output, chunk, count);
+		} else if (count == 0) {
+			return false;
+		} else if (errno == EINTR) {
+			continue;
+		} else {
+			// EAGAIN on a non-blocking pipe: nothing more for now
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+	}
+}
+
+void output_finish(OutputBuffer *output) {
+	if (output->tail.empty()) {
+		return;
+	}
+
+	if (output->dropped > 0) {
+		output->data += "\n[... " + std::to_string(output->dropped) + " bytes of output dropped ...]\n";
+	}
+	output->data.append(output->tail, output->tail_start, std::string::npos);
+	output->data.append(output->tail, 0, output->tail_start);
+	output->tail.clear();
+	output->tail_start = 0;
+}
+
+bool testcase_open(TestCase *testcase, std::string name, std::string fallback_dir) {
+	testcase->path = "/proc/self/fd/" + std::to_string(SUT_INPUT_FD);
+
+	// Close-on-exec, the child dup()s it to SUT_INPUT_FD itself so other
+	// workers' SUTs do not inherit it.
+	testcase->fd = memfd_create("fuzz-sat-input", MFD_CLOEXEC);
+	if (testcase->fd >= 0) {
+		return true;
+	}
+
+	for (std::string dir : {std::string("/dev/shm"), fallback_dir}) {
+		std::string fallback_path = dir + "/" + name;
+		testcase->fd = open(fallback_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (testcase->fd >= 0) {
+			unlink(fallback_path.c_str());
+			return true;
+		}
+	}
+
+	printf("Could not create a test case file: %s\n", strerror(errno));
+	return false;
+}
+
+bool testcase_write(TestCase *testcase, const std::string &input) {
+	size_t written = 0;
+	while (written < input.size()) {
+		ssize_t count = pwrite(testcase->fd, input.data() + written, input.size() - written, written);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		} else if (count <= 0) {
+			return false;
+		}
+		written += count;
+	}
+
+	// Drop whatever a longer previous test case left behind
+	return ftruncate(testcase->fd, input.size()) == 0;
+}
+
+void testcase_close(TestCase *testcase) {
+	if (testcase->fd >= 0) {
+		close(testcase->fd);
+	}
+	testcase->fd = -1;
+}
+
+static std::string unquote(std::string value) {
+	std::string out;
+	for (char c : value) {
+		if (c != '"' && c != '\'')
+			out += c;
+	}
+	return out;
+}
+
+bool read_runsat(std::string path_to_SUT, std::string *binary, std::vector<std::string> *exports) {
+	std::ifstream script(path_to_SUT + "/runsat.sh");
+	if (!script.is_open()) {
+		return false;
+	}
+
+	binary->clear();
+	exports->clear();
+
+	// runsat.sh scripts look like:
+	//   export UBSAN_OPTIONS=halt_on_error=false
+	//   "${SCRIPT_DIR}/sat" "$1" &
+	std::string line;
+	while (std::getline(script, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line[start] == '#') {
+			continue;
+		}
+		line = line.substr(start);
+
+		if (line.rfind("export ", 0) == 0) {
+			exports->push_back(unquote(line.substr(7)));
+			continue;
+		}
+
+		size_t dir = line.find(SCRIPT_DIR_BRACED);
+		size_t dir_length = sizeof(SCRIPT_DIR_BRACED) - 1;
+		if (dir == std::string::npos) {
+			dir = line.find(SCRIPT_DIR_PLAIN);
+			dir_length = sizeof(SCRIPT_DIR_PLAIN) - 1;
+		}
+
+		if (dir != std::string::npos && binary->empty()) {
+			size_t name_start = dir + dir_length;
+			size_t name_end = line.find_first_of("\" \t", name_start);
+			std::string name = line.substr(name_start, name_end - name_start);
+			*binary = (std::filesystem::path(path_to_SUT) / name).lexically_normal().string();
+		}
+	}
+
+	return !binary->empty() && access(binary->c_str(), X_OK) == 0;
+}
+
+void apply_environment(std::vector<std::string> *environment, const std::vector<std::string> &overrides) {
+	for (const std::string &entry : overrides) {
+		std::string name = entry.substr(0, entry.find('=') + 1);
+
+		bool replaced = false;
+		for (std::string &existing : *environment) {
+			if (existing.rfind(name, 0) == 0) {
+				existing = entry;
+				replaced = true;
+			}
+		}
+
+		if (!replaced)
+			environment->push_back(entry);
+	}
+}
+
+void deadline_start(Deadline *deadline, pid_t group, std::chrono::milliseconds timeout) {
+	deadline->group = group;
+	deadline->next = std::chrono::steady_clock::now() + timeout;
+	deadline->stage = 0;
+}
+
+int deadline_wait_ms(const Deadline *deadline) {
+	if (deadline->stage >= 2) {
+		return -1;
+	}
+
+	auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline->next - std::chrono::steady_clock::now());
+	return std::max((long) 0, (long) remaining.count());
+}
+
+bool deadline_expire(Deadline *deadline) {
+	if (deadline->stage >= 2 || std::chrono::steady_clock::now() < deadline->next) {
+		return deadline->stage > 0;
+	}
+
+	// runsat.sh forwards SIGTERM to the solver, anything ignoring it is
+	// killed after the grace period.
+	kill(-deadline->group, deadline->stage == 0 ? SIGTERM : SIGKILL);
+	deadline->stage++;
+	deadline->next += std::chrono::milliseconds(KILL_GRACE_MS);
+	return true;
+}
+
+// A descriptor that polls readable once pid exits, or -1 on kernels before 5.3
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+int interruptible_exec(const std::vector<std::string> &args, const std::vector<std::string> &environment, const TestCase *testcase, const ResourceLimits *limits, OutputBuffer *output, std::chrono::milliseconds timeout, bool *timed_out) {
+	*timed_out = false;
+
+	// Only async-signal-safe calls may follow a fork() in a multi-threaded
+	// process, so everything is prepared up front.
+	std::vector<char*> argv;
+	for (const std::string &arg : args)
+		argv.push_back((char*) arg.c_str());
+	argv.push_back(NULL);
+
+	std::vector<char*> envp;
+	for (const std::string &entry : environment)
+		envp.push_back((char*) entry.c_str());
+	envp.push_back(NULL);
+
+	output_clear(output);
+
+	// Close-on-exec, so that concurrent SUTs of other workers do not keep
+	// the write end open.
+	int output_pipe[2];
+	if (pipe2(output_pipe, O_CLOEXEC)) {
+		return -1;
+	}
+
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		// Could not fork.
+		close(output_pipe[0]);
+		close(output_pipe[1]);
+		return -1;
+	} else if (pid == 0) {
+		// This is the child. Run the SUT in a group of its own, so that a
+		// timeout takes runsat.sh and the solver down together.
+		setpgid(0, 0);
+		dup2(output_pipe[1], STDOUT_FILENO);
+		dup2(output_pipe[1], STDERR_FILENO);
+		dup2(testcase->fd, SUT_INPUT_FD);
+		limits_apply(limits);
+		execve(argv[0], argv.data(), envp.data());
+		_exit(127);
+	}
+
+	// Also from this side, the group has to exist before it can be killed.
+	setpgid(pid, pid);
+	close(output_pipe[1]);
+	fcntl(output_pipe[0], F_SETFL, O_NONBLOCK);
+
+	Deadline deadline;
+	deadline_start(&deadline, pid, timeout);
+
+	int pidfd = open_pidfd(pid);
+	bool output_open = true;
+	bool exited = false;
+	bool reaped = false;
+	int child_res = 0;
+
+	while (!exited) {
+		struct pollfd poll_fds[2] = {
+			{output_open ? output_pipe[0] : -1, POLLIN, 0},
+			{pidfd, POLLIN, 0},
+		};
+
+		int timeout_ms = deadline_wait_ms(&deadline);
+		if (pidfd < 0 && (timeout_ms < 0 || timeout_ms > EXIT_POLL_MS)) {
+			timeout_ms = EXIT_POLL_MS;
+		}
+
+		if (poll(poll_fds, 2, timeout_ms) < 0 && errno != EINTR) {
+			break;
+		}
+
+		if (output_open && (poll_fds[0].revents & (POLLIN | POLLHUP))) {
+			output_open = output_drain(output_pipe[0], output);
+		}
+
+		if (pidfd >= 0) {
+			exited = poll_fds[1].revents & POLLIN;
+		} else if (waitpid(pid, &child_res, WNOHANG) == pid) {
+			reaped = true;
+			exited = true;
+		}
+
+		if (!exited && deadline_expire(&deadline)) {
+			*timed_out = true;
+		}
+	}
+
+	// Whatever the child wrote before exiting is in the pipe. Anything left
+	// in its group would only keep the pipe open.
+	output_drain(output_pipe[0], output);
+	close(output_pipe[0]);
+	output_finish(output);
+
+	if (pidfd >= 0) {
+		close(pidfd);
+	}
+
+	if (reaped) {
+		return child_res;
+	}
+
+	// The child is a zombie until reaped, its group id cannot be reused yet.
+	kill(-pid, SIGKILL);
+
+	// Wait for our own child only, other workers have children too.
+	if (waitpid(pid, &child_res, 0) != pid) {
+		return -1;
+	}
+	return child_res;
+}
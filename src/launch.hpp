@@ -0,0 +1,98 @@
+#ifndef LAUNCH_HPP
+#define LAUNCH_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "resources.hpp"
+
+/*
+	Running the SUT either through its runsat.sh or, in direct mode, by
+	exec'ing the solver binary runsat.sh would have started. Direct mode skips
+	the /bin/sh and bash startups, which cost more than the solver itself on
+	most small inputs.
+*/
+
+// Default cap on the SUT output kept per execution.
+#define DEFAULT_OUTPUT_CAP (4 * 1024 * 1024)
+
+// The SUT finds its test case on this descriptor, as /proc/self/fd/197.
+#define SUT_INPUT_FD 197
+
+// Time a timed out SUT gets between SIGTERM and SIGKILL.
+#define KILL_GRACE_MS 20
+
+// Sanitizer options used when runsat.sh does not export any.
+#define DEFAULT_UBSAN_OPTIONS "UBSAN_OPTIONS=halt_on_error=false"
+#define DEFAULT_ASAN_OPTIONS "ASAN_OPTIONS=halt_on_error=false:detect_leaks=0"
+
+// What the SUT printed on stdout and stderr, captured over a pipe. The buffers
+// are reused across executions. Once more than cap bytes arrive, the first
+// half of the cap and the most recent half are kept, as sanitizer reports end
+// up at either end of a long printed model.
+typedef struct {
+	size_t cap;
+
+	std::string data;
+
+	// Ring of the most recent bytes, once data holds its half of the cap.
+	std::string tail;
+	size_t tail_start;
+	size_t dropped;
+} OutputBuffer;
+
+void output_init(OutputBuffer *output, size_t cap);
+void output_clear(OutputBuffer *output);
+void output_append(OutputBuffer *output, const char *bytes, size_t count);
+// Read everything currently available on fd. Returns false once fd is at EOF.
+bool output_drain(int fd, OutputBuffer *output);
+// Join the kept head and tail into data.
+void output_finish(OutputBuffer *output);
+
+// The test case handed to the SUT. It lives in a memfd (or, failing that, a
+// tmpfs file) that is rewritten in place for every execution, and reaches the
+// SUT as SUT_INPUT_FD.
+typedef struct {
+	int fd;
+
+	// What the SUT is given as its input file
+	std::string path;
+} TestCase;
+
+// Without memfd_create, name is created under /dev/shm, or else fallback_dir.
+bool testcase_open(TestCase *testcase, std::string name, std::string fallback_dir);
+bool testcase_write(TestCase *testcase, const std::string &input);
+void testcase_close(TestCase *testcase);
+
+// Read the solver binary and the variables runsat.sh exports for it. Returns
+// false if the binary could not be found in the script.
+bool read_runsat(std::string path_to_SUT, std::string *binary, std::vector<std::string> *exports);
+
+// Replace or add every VAR=value of overrides in environment.
+void apply_environment(std::vector<std::string> *environment, const std::vector<std::string> &overrides);
+
+// The timeout of one execution. Every SUT runs in a process group of its own,
+// which gets SIGTERM once the deadline passes and SIGKILL KILL_GRACE_MS later.
+typedef struct {
+	pid_t group;
+	std::chrono::steady_clock::time_point next;
+
+	// Signals sent so far
+	int stage;
+} Deadline;
+
+void deadline_start(Deadline *deadline, pid_t group, std::chrono::milliseconds timeout);
+// Milliseconds until the next signal is due, as a poll() timeout.
+int deadline_wait_ms(const Deadline *deadline);
+// Send the next signal if it is due. Returns true once the deadline passed.
+bool deadline_expire(Deadline *deadline);
+
+// fork() and execve() args[0] in a new process group under limits, with
+// stdout and stderr captured in output and the test case on SUT_INPUT_FD.
+// Waits for the child, killing its group once timeout expires, and returns
+// its wait status or -1 on failure.
+int interruptible_exec(const std::vector<std::string> &args, const std::vector<std::string> &environment, const TestCase *testcase, const ResourceLimits *limits, OutputBuffer *output, std::chrono::milliseconds timeout, bool *timed_out);
+
+#endif
@@ -159,10 +159,11 @@ std::string random_mutate(
                 continue; 
             }
 
+            // Not '-', which negates a literal
             static const char junk_characters[] =
             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
             "abcdefghijklmnopqrstuvwxyz"
-            "!@#$%^&*()_+-=;,./<>?|{}:";
+            "!@#$%^&*()_+=;,./<>?|{}:";
             
             // At this stage, our generated code has fooled our fuzzer into 
             // believing that it is a real cnf file... 
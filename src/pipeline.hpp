@@ -0,0 +1,122 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+	Every worker runs as three stages: a generator producing test cases, the
+	executor running the SUT on them and reading back their coverage counters,
+	and a triage stage classifying the output and merging the coverage. The
+	stages are joined by bounded single-producer, single-consumer rings, so
+	generating the next inputs and triaging the last ones overlap with the
+	SUT's run time. A stage that finds
+	its ring full (or empty) waits, and the time it spends doing so is counted
+	as that stage's stall time.
+*/
+
+// Inputs generated ahead of the strategy feedback they are waiting on
+#define PIPELINE_DEPTH 4
+#define RING_CAPACITY 8
+
+// A waiting stage spins this many times before it starts sleeping
+#define RING_SPINS 64
+#define RING_SLEEP_US 50
+
+template <typename T>
+struct Ring {
+	T slots[RING_CAPACITY];
+
+	// Only the consumer advances head, only the producer advances tail.
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+
+	// Set by either side once it stops
+	std::atomic<bool> closed;
+};
+
+template <typename T>
+void ring_init(Ring<T> *ring) {
+	ring->head = 0;
+	ring->tail = 0;
+	ring->closed = false;
+}
+
+template <typename T>
+size_t ring_size(const Ring<T> *ring) {
+	return ring->tail.load(std::memory_order_acquire) - ring->head.load(std::memory_order_acquire);
+}
+
+template <typename T>
+void ring_close(Ring<T> *ring) {
+	ring->closed.store(true, std::memory_order_release);
+}
+
+static inline void ring_wait(int *spins) {
+	if (++*spins < RING_SPINS) {
+		std::this_thread::yield();
+	} else {
+		std::this_thread::sleep_for(std::chrono::microseconds(RING_SLEEP_US));
+	}
+}
+
+// Blocks while the ring is full. Returns false once the consumer closed it.
+template <typename T>
+bool ring_push(Ring<T> *ring, T &&item, std::atomic<uint64_t> *stall_ns) {
+	size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+	auto start = std::chrono::steady_clock::now();
+	int spins = 0;
+	while (tail - ring->head.load(std::memory_order_acquire) == RING_CAPACITY) {
+		if (ring->closed.load(std::memory_order_acquire)) {
+			return false;
+		}
+		ring_wait(&spins);
+	}
+	if (spins > 0) {
+		*stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	if (ring->closed.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	ring->slots[tail % RING_CAPACITY] = std::move(item);
+	ring->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+// Blocks while the ring is empty. Returns false once it is empty and closed.
+template <typename T>
+bool ring_pop(Ring<T> *ring, T *item, std::atomic<uint64_t> *stall_ns) {
+	size_t head = ring->head.load(std::memory_order_relaxed);
+
+	auto start = std::chrono::steady_clock::now();
+	int spins = 0;
+	while (ring->tail.load(std::memory_order_acquire) == head) {
+		if (ring->closed.load(std::memory_order_acquire) && ring->tail.load(std::memory_order_acquire) == head) {
+			return false;
+		}
+		ring_wait(&spins);
+	}
+	if (spins > 0) {
+		*stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	*item = std::move(ring->slots[head % RING_CAPACITY]);
+	ring->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+// Time each stage spent waiting on its rings
+typedef struct {
+	std::atomic<uint64_t> generate_stall_ns;
+	std::atomic<uint64_t> execute_stall_ns;
+	std::atomic<uint64_t> analyze_stall_ns;
+} PipelineStats;
+
+#endif
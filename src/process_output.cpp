@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <string.h>
 
 #include "process_output.hpp"
 
 
 
-undefined_behaviour_t process_output(std::string output) {
+undefined_behaviour_t process_output(const std::string &output) {
 	if (std::string::npos != output.find(OUTPUT_SIGNED_INTEGER_OVERFLOW)){
 		return signed_overflow;	
 	} else if (std::string::npos != output.find(OUTPUT_VLA_BOUND)){
@@ -33,3 +36,98 @@ undefined_behaviour_t process_output(std::string output) {
 		return uncategorized;
 	}	
 }
+
+std::string crash_site(const std::string &output) {
+	size_t summary = output.find("SUMMARY: ");
+	size_t runtime_error = output.find(": runtime error:");
+
+	// UBSan reports do not stop the run, so an ASan report may come later
+	if (runtime_error != std::string::npos && (summary == std::string::npos || runtime_error < summary)) {
+		size_t line = output.rfind('\n', runtime_error);
+		line = line == std::string::npos ? 0 : line + 1;
+		return output.substr(line, runtime_error - line);
+	}
+	if (summary != std::string::npos) {
+		size_t end = output.find('\n', summary);
+		return output.substr(summary, end == std::string::npos ? std::string::npos : end - summary);
+	}
+	return "";
+}
+
+// FNV-1a
+#define SIGNATURE_HASH_SEED 0xcbf29ce484222325ULL
+
+static uint64_t signature_hash(uint64_t hash, const char *data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// A stack frame, "    #0 0x5595... in function file:line", without its pc.
+// Returns false for any other line.
+static bool frame_text(const std::string &output, size_t line, size_t end, size_t *text) {
+	size_t at = output.find_first_not_of(' ', line);
+	if (at >= end || output[at] != '#') {
+		return false;
+	}
+	size_t pc = output.find(' ', at);
+	if (pc >= end) {
+		return false;
+	}
+	size_t after_pc = output.find(' ', pc + 1);
+	*text = after_pc < end ? after_pc + 1 : end;
+	return true;
+}
+
+uint64_t crash_signature(const std::string &output, undefined_behaviour_t type) {
+	uint64_t hash = signature_hash(SIGNATURE_HASH_SEED, (const char *) &type, sizeof(type));
+
+	size_t report = output.find("ERROR: ");
+	size_t runtime_error = output.find(": runtime error:");
+	if (runtime_error != std::string::npos && runtime_error < report) {
+		report = output.rfind('\n', runtime_error);
+		report = report == std::string::npos ? 0 : report + 1;
+		// The location, the message has the values involved
+		hash = signature_hash(hash, output.data() + report, runtime_error - report);
+	} else if (report != std::string::npos) {
+		// The check: "ERROR: AddressSanitizer: heap-buffer-overflow on ..."
+		size_t check = output.find("Sanitizer: ", report);
+		size_t line_end = output.find('\n', report);
+		if (check < line_end) {
+			check += strlen("Sanitizer: ");
+			size_t check_end = std::min(output.find(' ', check), line_end);
+			hash = signature_hash(hash, output.data() + check, check_end - check);
+		}
+	} else {
+		return hash;
+	}
+
+	// The stack trace right after the report, if it has one. A few lines
+	// (the access, the signal) may come before it, another report may not.
+	int frames = 0;
+	int lines = 0;
+	size_t line = output.find('\n', report);
+	while (line != std::string::npos && frames < CRASH_SIGNATURE_FRAMES) {
+		line++;
+		size_t end = output.find('\n', line);
+		if (end == std::string::npos) {
+			end = output.size();
+		}
+
+		size_t text;
+		if (frame_text(output, line, end, &text)) {
+			hash = signature_hash(hash, output.data() + text, end - text);
+			frames++;
+		} else if (frames > 0 || ++lines > 4) {
+			break;
+		} else {
+			std::string_view content(output.data() + line, end - line);
+			if (content.find("ERROR: ") != std::string::npos || content.find(": runtime error:") != std::string::npos) {
+				break;
+			}
+		}
+		line = end < output.size() ? end : std::string::npos;
+	}
+	return hash;
+}
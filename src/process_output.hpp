@@ -1,3 +1,4 @@
+#include <cstdint>
 #include <string>
 
 
@@ -46,6 +47,11 @@ enum undefined_behaviour_t {
 	error,
 	uncategorized,
 	no_error,
+
+	// Stopped by a resource limit (see resources.hpp)
+	oom,
+	cpu_exceeded,
+
 	placeholder,
 
 	ub_end,
@@ -56,5 +62,19 @@ enum undefined_behaviour_t {
 // 	std::string err_str;	
 // };
 
-undefined_behaviour_t process_output(std::string output);
+undefined_behaviour_t process_output(const std::string &output);
+
+// Frames of a stack trace that make up a crash signature
+#define CRASH_SIGNATURE_FRAMES 3
+
+// A signature of the first report in output that stays the same across
+// runs: type, the sanitizer's check and the top frames of the stack trace
+// (function and file:line, without addresses). A UBSan report without a
+// stack trace has its location as its only frame.
+uint64_t crash_signature(const std::string &output, undefined_behaviour_t type);
+
+// Where the first report in output points to: the SUMMARY line of an
+// ASan report, or the file:line:column of a UBSan runtime error. Empty if
+// there is no report.
+std::string crash_site(const std::string &output);
 
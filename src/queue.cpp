@@ -0,0 +1,120 @@
+#include "queue.hpp"
+
+#include <algorithm>
+
+void queue_init(input_queue *queue, size_t arc_slots) {
+	queue->entries.clear();
+	queue->arc_hits.assign(arc_slots, 0);
+	queue->total_exec_us = 0;
+	queue->total_size = 0;
+	// The first selection wraps around to entry 0
+	queue->current = SIZE_MAX;
+	queue->energy_left = 0;
+}
+
+void queue_update(input_queue *queue, const coverage *trace, bool interesting, const std::string &input, uint32_t exec_us, uint32_t depth) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (trace->arc_coverage.bits != queue->arc_hits.size()) {
+		return;
+	}
+
+	// Only the set bits of the trace, word by word
+	size_t rarest_arc = 0;
+	uint32_t rarest_hits = UINT32_MAX;
+	const std::vector<uint64_t> &words = trace->arc_coverage.words;
+	for (size_t i = 0; i < words.size(); i++) {
+		for (uint64_t word = words[i]; word; word &= word - 1) {
+			size_t arc = i * BITMAP_WORD_BITS + __builtin_ctzll(word);
+			uint32_t hits = ++queue->arc_hits[arc];
+			if (hits < rarest_hits) {
+				rarest_hits = hits;
+				rarest_arc = arc;
+			}
+		}
+	}
+
+	if (!interesting) {
+		return;
+	}
+
+	queue->entries.push_back({input, exec_us, depth, rarest_arc, 0});
+	queue->total_exec_us += exec_us;
+	queue->total_size += input.size();
+}
+
+// AFL's performance score, 100 for an average entry
+static double performance_score(const input_queue *queue, const queue_entry *entry) {
+	double average_us = (double) queue->total_exec_us / queue->entries.size();
+	double average_size = (double) queue->total_size / queue->entries.size();
+	double score = 100;
+
+	if (entry->exec_us * 0.1 > average_us) {
+		score = 10;
+	} else if (entry->exec_us * 0.25 > average_us) {
+		score = 25;
+	} else if (entry->exec_us * 0.5 > average_us) {
+		score = 50;
+	} else if (entry->exec_us * 0.75 > average_us) {
+		score = 75;
+	} else if (entry->exec_us * 4 < average_us) {
+		score = 300;
+	} else if (entry->exec_us * 3 < average_us) {
+		score = 200;
+	} else if (entry->exec_us * 2 < average_us) {
+		score = 150;
+	}
+
+	// Small inputs are cheaper to mutate and easier to reason about
+	if (entry->input.size() * 2 < average_size) {
+		score *= 1.5;
+	} else if (entry->input.size() > average_size * 2) {
+		score *= 0.75;
+	}
+
+	// Deep entries come from long chains of finds, which are worth following
+	if (entry->depth >= 25) {
+		score *= 5;
+	} else if (entry->depth >= 14) {
+		score *= 4;
+	} else if (entry->depth >= 8) {
+		score *= 3;
+	} else if (entry->depth >= 4) {
+		score *= 2;
+	}
+
+	return score;
+}
+
+static uint32_t entry_energy(const input_queue *queue, const queue_entry *entry) {
+	uint32_t level = std::min(entry->fuzzed, (uint32_t) QUEUE_MAX_FUZZ_LEVEL);
+	uint32_t hits = std::max(queue->arc_hits[entry->rarest_arc], (uint32_t) 1);
+	double factor = std::min((double) (1u << level) / hits, (double) QUEUE_MAX_FACTOR);
+
+	double energy = QUEUE_BASE_ENERGY * performance_score(queue, entry) / 100 * factor;
+	return (uint32_t) std::clamp(energy, 1.0, (double) QUEUE_MAX_ENERGY);
+}
+
+bool queue_next(input_queue *queue, std::string *input, uint32_t *depth) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->entries.empty()) {
+		return false;
+	}
+
+	if (queue->energy_left == 0) {
+		queue->current = (queue->current + 1) % queue->entries.size();
+		queue_entry *entry = &queue->entries[queue->current];
+		queue->energy_left = entry_energy(queue, entry);
+		entry->fuzzed++;
+	}
+	queue->energy_left--;
+
+	const queue_entry *entry = &queue->entries[queue->current];
+	*input = entry->input;
+	*depth = entry->depth;
+	return true;
+}
+
+size_t queue_size(input_queue *queue) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	return queue->entries.size();
+}
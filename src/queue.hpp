@@ -0,0 +1,67 @@
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "coverage.hpp"
+
+/*
+	The queue of interesting inputs: every input that added coverage, kept to
+	be mutated again. Entries are taken in turn, and each one yields as many
+	mutants as its energy before the next is taken, so selection is O(1).
+
+	The energy follows AFLFast's FAST power schedule. A base energy is scaled
+	by how fast and small the input is compared to the average entry and by
+	its depth (the number of mutations it is away from a generated input or
+	seed), as AFL does. It is then multiplied by 2^s / f, where s is the
+	number of times the entry was selected and f the number of executions
+	that covered the rarest arc the entry covered. Entries that exercise
+	rarely reached code get more mutants, ones on well-trodden paths fewer.
+*/
+
+#define QUEUE_BASE_ENERGY 8
+#define QUEUE_MAX_ENERGY 256
+// Selections past which the energy stops doubling
+#define QUEUE_MAX_FUZZ_LEVEL 16
+#define QUEUE_MAX_FACTOR 32
+
+typedef struct {
+	std::string input;
+	uint32_t exec_us;
+	uint32_t depth;
+	// The arc of the input fewest executions had covered when it was added
+	size_t rarest_arc;
+	// Times the entry was selected
+	uint32_t fuzzed;
+} queue_entry;
+
+typedef struct {
+	std::vector<queue_entry> entries;
+	// Executions that covered each arc slot
+	std::vector<uint32_t> arc_hits;
+	uint64_t total_exec_us;
+	uint64_t total_size;
+
+	// Entry being mutated and the mutants it has left
+	size_t current;
+	uint32_t energy_left;
+
+	std::mutex mutex;
+} input_queue;
+
+void queue_init(input_queue *queue, size_t arc_slots);
+
+// Count the arcs an execution covered, and queue its input if it found new
+// coverage
+void queue_update(input_queue *queue, const coverage *trace, bool interesting, const std::string &input, uint32_t exec_us, uint32_t depth);
+
+// The next input to mutate and its depth. False while the queue is empty.
+bool queue_next(input_queue *queue, std::string *input, uint32_t *depth);
+
+size_t queue_size(input_queue *queue);
+
+#endif
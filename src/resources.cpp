@@ -0,0 +1,255 @@
+#include "resources.hpp"
+#include "elf.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// What the SUT prints when an allocation fails
+#define OUTPUT_RSS_LIMIT "rss limit exhausted"
+#define OUTPUT_OUT_OF_MEMORY "out of memory"
+#define OUTPUT_FAILED_MMAP "Failed to mmap"
+#define OUTPUT_BAD_ALLOC "std::bad_alloc"
+
+static std::string read_file(std::string path) {
+	std::ifstream file(path);
+	std::stringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+static bool write_file(std::string path, std::string content) {
+	int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	bool written = write(fd, content.data(), content.size()) == (ssize_t) content.size();
+	close(fd);
+	return written;
+}
+
+// Sanitizers that reserve their shadow memory up front cannot run under
+// RLIMIT_AS.
+static bool is_sanitized(std::string binary) {
+	elf_dynamic dynamic;
+	if (!elf_read_dynamic(binary, &dynamic)) {
+		return true;
+	}
+
+	for (const std::string &needed : dynamic.needed) {
+		for (const char *runtime : {"libasan", "libmsan", "libtsan"}) {
+			if (needed.find(runtime) != std::string::npos) {
+				return true;
+			}
+		}
+	}
+	// Statically linked runtimes
+	return elf_has_symbol(binary, {"__asan_init", "__msan_init", "__tsan_init"});
+}
+
+// Where the cgroup v2 hierarchy is mounted, or "" on cgroup v1 only hosts
+static std::string cgroup2_mount() {
+	std::ifstream mounts("/proc/self/mounts");
+	std::string device, path, type, rest;
+	while (mounts >> device >> path >> type && std::getline(mounts, rest)) {
+		if (type == "cgroup2") {
+			return path;
+		}
+	}
+	return "";
+}
+
+static uint64_t read_oom_kills(std::string cgroup) {
+	std::ifstream events(cgroup + "/memory.events");
+	std::string key;
+	uint64_t value;
+	while (events >> key >> value) {
+		if (key == "oom_kill") {
+			return value;
+		}
+	}
+	return 0;
+}
+
+// Whether the children of cgroup can be given memory.max
+static bool enable_memory(std::string cgroup) {
+	std::string controllers = read_file(cgroup + "/cgroup.subtree_control");
+	if (controllers.find("memory") != std::string::npos) {
+		return true;
+	}
+	return write_file(cgroup + "/cgroup.subtree_control", "+memory");
+}
+
+// The cgroup the worker leaves go in, "" if none can limit memory. A cgroup
+// that holds processes cannot enable controllers for its children, so the
+// fuzzer first moves itself into a leaf next to the workers'.
+static std::string memory_parent() {
+	std::string mount = cgroup2_mount();
+	if (mount.empty()) {
+		return "";
+	}
+
+	// The v2 entry of /proc/self/cgroup reads "0::/path"
+	std::ifstream cgroups("/proc/self/cgroup");
+	std::string line, own;
+	while (std::getline(cgroups, line)) {
+		if (line.rfind("0::", 0) == 0) {
+			own = line.substr(3);
+		}
+	}
+
+	std::string parent = mount + own;
+	if (enable_memory(parent)) {
+		return parent;
+	}
+
+	std::string self = parent + "/fuzz-sat-" + std::to_string(getpid());
+	if (mkdir(self.c_str(), 0755) != 0 && errno != EEXIST) {
+		return "";
+	}
+	if (write_file(self + "/cgroup.procs", "0") && enable_memory(parent)) {
+		return parent;
+	}
+
+	// Other processes still share the cgroup
+	write_file(parent + "/cgroup.procs", "0");
+	rmdir(self.c_str());
+	return "";
+}
+
+// Create a leaf with memory.max set. Fails unless the memory controller is
+// delegated to our cgroup.
+static bool open_cgroup(ResourceLimits *limits, std::string name) {
+	// Once per process, the fuzzer is no longer in its own cgroup afterwards
+	static const std::string parent = memory_parent();
+	if (parent.empty()) {
+		return false;
+	}
+
+	std::string leaf = parent + "/" + name;
+	if (mkdir(leaf.c_str(), 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	if (!write_file(leaf + "/memory.max", std::to_string(limits->memory_mb << 20))) {
+		rmdir(leaf.c_str());
+		return false;
+	}
+	// Swapping would only hide the limit
+	write_file(leaf + "/memory.swap.max", "0");
+
+	limits->cgroup = leaf;
+	limits->cgroup_procs = leaf + "/cgroup.procs";
+	limits->oom_kills = read_oom_kills(leaf);
+	return true;
+}
+
+void limits_init(ResourceLimits *limits, size_t memory_mb, int cpu_seconds, size_t file_size_mb, std::string sut_binary, std::string name) {
+	limits->memory_mb = memory_mb;
+	limits->cpu_seconds = cpu_seconds;
+	limits->file_size_mb = file_size_mb;
+	limits->address_space = false;
+	limits->cgroup.clear();
+	limits->cgroup_procs.clear();
+	limits->oom_kills = 0;
+
+	if (memory_mb == 0 || open_cgroup(limits, name)) {
+		return;
+	}
+
+	limits->address_space = !is_sanitized(sut_binary);
+}
+
+void limits_close(ResourceLimits *limits) {
+	if (!limits->cgroup.empty()) {
+		rmdir(limits->cgroup.c_str());
+	}
+	limits->cgroup.clear();
+}
+
+void limits_environment(const ResourceLimits *limits, std::vector<std::string> *environment) {
+	if (limits->memory_mb == 0 || !limits->cgroup.empty() || limits->address_space) {
+		return;
+	}
+
+	// Checked by a background thread of the sanitizer runtime
+	std::string option = "hard_rss_limit_mb=" + std::to_string(limits->memory_mb);
+	for (std::string &entry : *environment) {
+		if (entry.rfind("ASAN_OPTIONS=", 0) == 0) {
+			entry += ":" + option;
+			return;
+		}
+	}
+	environment->push_back("ASAN_OPTIONS=" + option);
+}
+
+static void set_limit(int resource, rlim_t soft, rlim_t hard) {
+	struct rlimit limit = {soft, hard};
+	setrlimit(resource, &limit);
+}
+
+void limits_apply(const ResourceLimits *limits) {
+	if (!limits->cgroup_procs.empty()) {
+		int fd = open(limits->cgroup_procs.c_str(), O_WRONLY | O_CLOEXEC);
+		if (fd >= 0) {
+			// On failure the SUT just runs without the memory limit
+			ssize_t written = write(fd, "0", 1);
+			(void) written;
+			close(fd);
+		}
+	}
+
+	if (limits->address_space) {
+		rlim_t bytes = (rlim_t) limits->memory_mb << 20;
+		set_limit(RLIMIT_AS, bytes, bytes);
+	}
+
+	// SIGXCPU at the limit, SIGKILL a second later
+	if (limits->cpu_seconds > 0) {
+		set_limit(RLIMIT_CPU, limits->cpu_seconds, limits->cpu_seconds + 1);
+	}
+
+	if (limits->file_size_mb > 0) {
+		rlim_t bytes = (rlim_t) limits->file_size_mb << 20;
+		set_limit(RLIMIT_FSIZE, bytes, bytes);
+	}
+}
+
+limit_hit_t limits_check(ResourceLimits *limits, int wait_status, const std::string &output) {
+	if (!limits->cgroup.empty()) {
+		uint64_t oom_kills = read_oom_kills(limits->cgroup);
+		if (oom_kills > limits->oom_kills) {
+			limits->oom_kills = oom_kills;
+			return limit_memory;
+		}
+	}
+
+	// runsat.sh exits with 128 + the signal that killed the solver
+	int signal = 0;
+	if (wait_status != -1 && WIFSIGNALED(wait_status)) {
+		signal = WTERMSIG(wait_status);
+	} else if (wait_status != -1 && WIFEXITED(wait_status) && WEXITSTATUS(wait_status) > 128) {
+		signal = WEXITSTATUS(wait_status) - 128;
+	}
+
+	if (signal == SIGXCPU) {
+		return limit_cpu;
+	}
+
+	if (limits->memory_mb == 0) {
+		return limit_none;
+	}
+
+	for (const char *message : {OUTPUT_RSS_LIMIT, OUTPUT_OUT_OF_MEMORY, OUTPUT_FAILED_MMAP, OUTPUT_BAD_ALLOC}) {
+		if (output.find(message) != std::string::npos) {
+			return limit_memory;
+		}
+	}
+	return limit_none;
+}
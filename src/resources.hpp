@@ -0,0 +1,62 @@
+#ifndef RESOURCES_HPP
+#define RESOURCES_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Per-execution resource limits for the SUT. Some generated instances make
+	the solvers allocate gigabytes or spin in several threads, which would
+	otherwise swap the host and stall every worker.
+
+	Memory is capped by a cgroup v2 leaf per worker when the memory controller
+	is delegated to us, and otherwise by RLIMIT_AS. Sanitized solvers reserve
+	terabytes of shadow memory up front, so for them RLIMIT_AS is replaced by
+	ASan's own hard_rss_limit_mb. CPU time and file size are always rlimits.
+*/
+
+#define DEFAULT_MEMORY_LIMIT_MB 2048
+#define DEFAULT_CPU_LIMIT_S 10
+#define DEFAULT_FILE_SIZE_LIMIT_MB 64
+
+// Which limit an execution ran into
+enum limit_hit_t {
+	limit_none,
+	limit_memory,
+	limit_cpu,
+};
+
+typedef struct {
+	// 0 leaves the resource unlimited
+	size_t memory_mb;
+	int cpu_seconds;
+	size_t file_size_mb;
+
+	// Cap memory with RLIMIT_AS, false for sanitized SUTs
+	bool address_space;
+
+	// The worker's cgroup v2 leaf, empty without one
+	std::string cgroup;
+	// Written by the child to move itself into the leaf
+	std::string cgroup_procs;
+	// memory.events oom_kill count seen so far
+	uint64_t oom_kills;
+} ResourceLimits;
+
+// Set up the limits for one worker. name is used for its cgroup leaf.
+void limits_init(ResourceLimits *limits, size_t memory_mb, int cpu_seconds, size_t file_size_mb, std::string sut_binary, std::string name);
+void limits_close(ResourceLimits *limits);
+
+// Add the sanitizer options that enforce the memory limit.
+void limits_environment(const ResourceLimits *limits, std::vector<std::string> *environment);
+
+// Apply the limits to the calling process. Called in the child between fork()
+// and execve(), so only async-signal-safe calls are made.
+void limits_apply(const ResourceLimits *limits);
+
+// Whether the execution that returned wait_status and printed output was
+// stopped by one of the limits.
+limit_hit_t limits_check(ResourceLimits *limits, int wait_status, const std::string &output);
+
+#endif
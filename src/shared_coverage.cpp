@@ -0,0 +1,166 @@
+#include "shared_coverage.hpp"
+
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The bitmaps start on their own cache line
+#define SHARED_HEADER_SIZE 64
+
+static size_t shared_size(coverage_model *model, size_t *arc_words, size_t *hit_words, size_t *function_words) {
+	hit_count_map hits;
+	hit_map_init(&hits, model->arc_slots);
+
+	*arc_words = model->arc_slots / BITMAP_WORD_BITS;
+	*hit_words = hits.bytes.size() / sizeof(uint64_t);
+	*function_words = model->function_slots / BITMAP_WORD_BITS;
+	return SHARED_HEADER_SIZE + (*arc_words + *hit_words + *function_words) * sizeof(uint64_t);
+}
+
+// Wait for the creator to size the segment and fill in its header
+static bool wait_for_creator(int fd, size_t size, shared_coverage_header **header, void **memory) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_COVERAGE_WAIT_MS);
+
+	struct stat st;
+	while (fstat(fd, &st) == 0 && (size_t) st.st_size < SHARED_HEADER_SIZE) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if ((size_t) st.st_size != size) {
+		return false;
+	}
+
+	*memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*memory == MAP_FAILED) {
+		*memory = NULL;
+		return false;
+	}
+	*header = (shared_coverage_header *) *memory;
+
+	while (!__atomic_load_n(&(*header)->ready, __ATOMIC_ACQUIRE)) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+bool shared_coverage_open(shared_coverage *shared, std::string name, coverage_model *model) {
+	*shared = {};
+	shared->name = name[0] == '/' ? name : "/" + name;
+	shared->size = shared_size(model, &shared->arc_word_count, &shared->hit_word_count, &shared->function_word_count);
+
+	bool created = true;
+	int fd = shm_open(shared->name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(shared->name.c_str(), O_RDWR | O_CLOEXEC, 0600);
+	}
+	if (fd < 0) {
+		printf("Could not open shared coverage %s: %s\n", shared->name.c_str(), strerror(errno));
+		return false;
+	}
+
+	shared_coverage_header *header = NULL;
+	if (created) {
+		// The segment starts out zeroed, i.e. with nothing covered
+		if (ftruncate(fd, shared->size) != 0) {
+			printf("Could not size shared coverage %s: %s\n", shared->name.c_str(), strerror(errno));
+			close(fd);
+			shm_unlink(shared->name.c_str());
+			return false;
+		}
+		shared->memory = mmap(NULL, shared->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (shared->memory == MAP_FAILED) {
+			shared->memory = NULL;
+		} else {
+			header = (shared_coverage_header *) shared->memory;
+			header->magic = SHARED_COVERAGE_MAGIC;
+			header->version = SHARED_COVERAGE_VERSION;
+			header->layout = model->layout;
+			header->arc_slots = model->arc_slots;
+			header->function_slots = model->function_slots;
+			__atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+		}
+	} else if (!wait_for_creator(fd, shared->size, &header, &shared->memory)) {
+		header = NULL;
+	}
+	close(fd);
+
+	if (!header || header->magic != SHARED_COVERAGE_MAGIC || header->version != SHARED_COVERAGE_VERSION
+		|| header->layout != model->layout || header->arc_slots != model->arc_slots || header->function_slots != model->function_slots) {
+		printf("Shared coverage %s is not laid out for this SUT.\n", shared->name.c_str());
+		shared_coverage_close(shared);
+		return false;
+	}
+
+	char *words = (char *) shared->memory + SHARED_HEADER_SIZE;
+	shared->arc_words = (uint64_t *) words;
+	shared->hit_words = shared->arc_words + shared->arc_word_count;
+	shared->function_words = shared->hit_words + shared->hit_word_count;
+	return true;
+}
+
+void shared_coverage_close(shared_coverage *shared) {
+	if (shared->memory) {
+		munmap(shared->memory, shared->size);
+	}
+	shared->memory = NULL;
+	shared->arc_words = NULL;
+	shared->hit_words = NULL;
+	shared->function_words = NULL;
+}
+
+// OR words into the shared ones and return the bits that were new. The shared
+// word is only written when it lacks some of the bits, as most executions add
+// nothing and every write would pull the cache line away from the other
+// instances.
+static void merge_words(uint64_t *shared, const void *words, size_t count, void (*count_new)(uint64_t, uint64_t *), uint64_t *new_count) {
+	for (size_t i = 0; i < count; i++) {
+		uint64_t word;
+		memcpy(&word, (const char *) words + i * sizeof(uint64_t), sizeof(uint64_t));
+		if (word == 0 || (__atomic_load_n(&shared[i], __ATOMIC_RELAXED) & word) == word) {
+			continue;
+		}
+		uint64_t old = __atomic_fetch_or(&shared[i], word, __ATOMIC_RELAXED);
+		count_new(word & ~old, new_count);
+	}
+}
+
+static void count_bits(uint64_t added, uint64_t *count) {
+	*count += __builtin_popcountll(added);
+}
+
+// Hit count words hold a byte per arc
+static void count_bytes(uint64_t added, uint64_t *count) {
+	for (; added; added >>= 8) {
+		*count += (added & 0xff) != 0;
+	}
+}
+
+coverage_diff shared_coverage_merge(shared_coverage *shared, const coverage *cur) {
+	coverage_diff diff = {};
+	uint64_t arcs = 0, buckets = 0, functions = 0;
+
+	if (cur->arc_coverage.words.size() != shared->arc_word_count || cur->function_coverage.words.size() != shared->function_word_count) {
+		return diff;
+	}
+
+	merge_words(shared->arc_words, cur->arc_coverage.words.data(), shared->arc_word_count, count_bits, &arcs);
+	merge_words(shared->hit_words, cur->arc_hits.bytes.data(), shared->hit_word_count, count_bytes, &buckets);
+	merge_words(shared->function_words, cur->function_coverage.words.data(), shared->function_word_count, count_bits, &functions);
+
+	diff.new_unique_arcs_executed = arcs;
+	diff.new_hit_buckets = buckets;
+	diff.new_unique_funcs_executed = functions;
+	return diff;
+}
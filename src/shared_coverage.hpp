@@ -0,0 +1,60 @@
+#ifndef SHARED_COVERAGE_HPP
+#define SHARED_COVERAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "coverage.hpp"
+
+/*
+	Coverage shared by every fuzz-sat process fuzzing the same SUT, in a POSIX
+	shared memory segment. It holds the arc bitmap, hit count map and function
+	bitmap of all instances together. Each instance ORs the coverage of its
+	executions into it word by word with atomic fetch-or, and only counts an
+	input as new if it set bits no instance had set before. There is no
+	coordinator: the first instance creates the segment, the others open it,
+	and it stays until it is unlinked (rm /dev/shm/<name>).
+
+	The segment is laid out by the coverage model, so only instances of the
+	same SUT build can share one.
+*/
+
+#define SHARED_COVERAGE_MAGIC 0x667a7367 // fzsg
+#define SHARED_COVERAGE_VERSION 1
+// How long to wait for the creating instance to lay the segment out
+#define SHARED_COVERAGE_WAIT_MS 5000
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t layout;
+	uint64_t arc_slots;
+	uint64_t function_slots;
+	// Set by the creator once the header is filled in
+	uint32_t ready;
+} shared_coverage_header;
+
+typedef struct {
+	std::string name;
+	void *memory;
+	size_t size;
+
+	// All word arrays in the segment, updated with atomic builtins only
+	uint64_t *arc_words;
+	size_t arc_word_count;
+	uint64_t *hit_words;
+	size_t hit_word_count;
+	uint64_t *function_words;
+	size_t function_word_count;
+} shared_coverage;
+
+// Create the segment, or open the one another instance created. Fails if
+// that one was made for a different SUT build.
+bool shared_coverage_open(shared_coverage *shared, std::string name, coverage_model *model);
+void shared_coverage_close(shared_coverage *shared);
+
+// OR cur into the shared coverage, counting what no instance had covered
+coverage_diff shared_coverage_merge(shared_coverage *shared, const coverage *cur);
+
+#endif
@@ -0,0 +1,47 @@
+#include "signature_set.hpp"
+
+void signature_set_init(signature_set *set) {
+	set->slots.assign(SIGNATURE_SET_INITIAL_SLOTS, 0);
+	set->count = 0;
+}
+
+// Signature 0 is stored as 1, as 0 marks an empty slot
+static uint64_t stored(uint64_t signature) {
+	return signature ? signature : 1;
+}
+
+// Slot signature is stored in or would go into, the signatures' low bits
+// are spread by a multiplication
+static size_t find_slot(const std::vector<uint64_t> &slots, uint64_t signature) {
+	size_t mask = slots.size() - 1;
+	size_t slot = (signature * 0x9e3779b97f4a7c15ULL) >> 32 & mask;
+	while (slots[slot] && slots[slot] != signature) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+static void grow(signature_set *set) {
+	std::vector<uint64_t> slots(set->slots.size() * 2, 0);
+	for (uint64_t signature : set->slots) {
+		if (signature) {
+			slots[find_slot(slots, signature)] = signature;
+		}
+	}
+	set->slots.swap(slots);
+}
+
+bool signature_set_insert(signature_set *set, uint64_t signature) {
+	signature = stored(signature);
+	size_t slot = find_slot(set->slots, signature);
+	if (set->slots[slot]) {
+		return false;
+	}
+
+	set->slots[slot] = signature;
+	set->count++;
+	if (set->count * 2 > set->slots.size()) {
+		grow(set);
+	}
+	return true;
+}
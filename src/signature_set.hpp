@@ -0,0 +1,29 @@
+#ifndef SIGNATURE_SET_HPP
+#define SIGNATURE_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+	The crash signatures seen so far in a campaign, so a bug is only new the
+	first time it is reported. An open-addressing table of 64-bit signatures
+	with linear probing, kept at most half full, so an insertion touches a
+	slot or two and stays O(1) however many crashes were seen. Nothing is
+	ever removed.
+*/
+
+#define SIGNATURE_SET_INITIAL_SLOTS 1024
+
+typedef struct {
+	// A power of two slots, 0 marks an empty slot
+	std::vector<uint64_t> slots;
+	size_t count;
+} signature_set;
+
+void signature_set_init(signature_set *set);
+
+// Add signature, returns false if it was in the set already
+bool signature_set_insert(signature_set *set, uint64_t signature);
+
+#endif
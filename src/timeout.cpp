@@ -0,0 +1,53 @@
+#include "timeout.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void timeouts_init(TimeoutModel *model, size_t strategies, std::chrono::milliseconds limit) {
+	model->limit = limit;
+	model->strategies.assign(strategies, ExecTimes());
+
+	for (ExecTimes &times : model->strategies) {
+		times.samples.reserve(TIMEOUT_SAMPLES);
+		times.next = 0;
+		times.since_calibration = 0;
+		times.timeout = limit;
+	}
+}
+
+std::chrono::milliseconds timeout_for(TimeoutModel *model, size_t strategy) {
+	std::lock_guard<std::mutex> lock(model->mutex);
+	return model->strategies[strategy].timeout;
+}
+
+static void calibrate(ExecTimes *times, std::chrono::milliseconds limit) {
+	std::vector<uint32_t> sorted = times->samples;
+	size_t rank = std::min(sorted.size() - 1, (size_t) (TIMEOUT_PERCENTILE * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+
+	auto percentile = std::chrono::microseconds(sorted[rank]);
+	auto timeout = std::chrono::ceil<std::chrono::milliseconds>(percentile * TIMEOUT_MULTIPLIER);
+	times->timeout = std::clamp(timeout, std::min(limit, std::chrono::milliseconds(TIMEOUT_FLOOR_MS)), limit);
+	times->since_calibration = 0;
+}
+
+bool timeouts_record(TimeoutModel *model, size_t strategy, std::chrono::microseconds time) {
+	std::lock_guard<std::mutex> lock(model->mutex);
+	ExecTimes *times = &model->strategies[strategy];
+
+	uint32_t sample = std::min<int64_t>(time.count(), std::numeric_limits<uint32_t>::max());
+	if (times->samples.size() < TIMEOUT_SAMPLES) {
+		times->samples.push_back(sample);
+	} else {
+		times->samples[times->next] = sample;
+	}
+	times->next = (times->next + 1) % TIMEOUT_SAMPLES;
+	times->since_calibration++;
+
+	size_t count = times->samples.size();
+	if (count == TIMEOUT_CALIBRATION || (count > TIMEOUT_CALIBRATION && times->since_calibration >= TIMEOUT_RECALIBRATE)) {
+		calibrate(times, model->limit);
+		return true;
+	}
+	return false;
+}
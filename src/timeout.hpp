@@ -0,0 +1,53 @@
+#ifndef TIMEOUT_HPP
+#define TIMEOUT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+	Adaptive SUT timeouts. Most generated instances are answered in a few
+	milliseconds, so the full limit is only worth waiting for on inputs that
+	are really slow. Execution times are sampled per generation strategy, and
+	once a strategy has TIMEOUT_CALIBRATION samples its timeout becomes the
+	TIMEOUT_PERCENTILE of its recent executions times TIMEOUT_MULTIPLIER,
+	kept between TIMEOUT_FLOOR_MS and the full limit. It is recalibrated every
+	TIMEOUT_RECALIBRATE samples.
+*/
+
+// Recent execution times kept per strategy
+#define TIMEOUT_SAMPLES 256
+// Executions run with the full limit before a strategy's timeout adapts
+#define TIMEOUT_CALIBRATION 32
+#define TIMEOUT_RECALIBRATE 64
+#define TIMEOUT_PERCENTILE 0.99
+#define TIMEOUT_MULTIPLIER 4
+#define TIMEOUT_FLOOR_MS 100
+
+typedef struct {
+	// Ring of execution times in microseconds
+	std::vector<uint32_t> samples;
+	size_t next;
+	size_t since_calibration;
+
+	// Until calibrated, the full limit
+	std::chrono::milliseconds timeout;
+} ExecTimes;
+
+// Shared by the workers of a campaign
+typedef struct {
+	std::chrono::milliseconds limit;
+	std::vector<ExecTimes> strategies;
+	std::mutex mutex;
+} TimeoutModel;
+
+void timeouts_init(TimeoutModel *model, size_t strategies, std::chrono::milliseconds limit);
+
+std::chrono::milliseconds timeout_for(TimeoutModel *model, size_t strategy);
+
+// Record how long an execution that finished in time took. Returns true if
+// the strategy's timeout was recalibrated.
+bool timeouts_record(TimeoutModel *model, size_t strategy, std::chrono::microseconds time);
+
+#endif
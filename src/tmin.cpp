@@ -0,0 +1,82 @@
+#include "tmin.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+static std::vector<std::string> split_units(const std::string &input, tmin_level level) {
+	std::vector<std::string> units;
+	size_t start = 0;
+	while (start < input.size()) {
+		size_t end = start + 1;
+		if (level == tmin_lines) {
+			end = input.find('\n', start);
+			end = end == std::string::npos ? input.size() : end + 1;
+		} else if (level == tmin_literals) {
+			// A literal with the whitespace after it
+			end = start;
+			while (end < input.size() && !isspace((unsigned char) input[end])) {
+				end++;
+			}
+			while (end < input.size() && isspace((unsigned char) input[end])) {
+				end++;
+			}
+		}
+		units.push_back(input.substr(start, end - start));
+		start = end;
+	}
+	return units;
+}
+
+static std::string join_without(const std::vector<std::string> &units, size_t begin, size_t end) {
+	std::string joined;
+	for (size_t i = 0; i < units.size(); i++) {
+		if (i < begin || i >= end) {
+			joined += units[i];
+		}
+	}
+	return joined;
+}
+
+std::string tmin_minimize(const std::string &input, size_t batch, tmin_test test, tmin_progress progress) {
+	std::string current = input;
+
+	for (int level = tmin_lines; level < tmin_level_end; level++) {
+		std::vector<std::string> units = split_units(current, (tmin_level) level);
+		size_t chunk = std::max(units.size() / 2, (size_t) 1);
+
+		while (!units.empty()) {
+			bool removed = false;
+			size_t start = 0;
+			while (start < units.size()) {
+				std::vector<std::string> candidates;
+				for (size_t at = start; at < units.size() && candidates.size() < batch; at += chunk) {
+					candidates.push_back(join_without(units, at, at + chunk));
+				}
+
+				size_t found = test(candidates);
+				if (found == SIZE_MAX) {
+					start += candidates.size() * chunk;
+					continue;
+				}
+
+				// What followed the removed chunk is tried next
+				start += found * chunk;
+				units.erase(units.begin() + start, units.begin() + std::min(start + chunk, units.size()));
+				removed = true;
+			}
+
+			if (chunk == 1 && !removed) {
+				break;
+			}
+			chunk = std::max(chunk / 2, (size_t) 1);
+		}
+
+		current.clear();
+		for (const std::string &unit : units) {
+			current += unit;
+		}
+		progress((tmin_level) level, current.size());
+	}
+
+	return current;
+}
@@ -0,0 +1,39 @@
+#ifndef TMIN_HPP
+#define TMIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+	Test case minimisation by delta debugging. An input is cut into units,
+	first lines (one clause each, as the generators write them), then
+	literals, then bytes, and chunks of units are removed for as long as the
+	input still fails the same way. The chunk size is halved whenever no
+	chunk can be removed, down to single units.
+
+	The removals that are tried next are tested as one batch, which the
+	caller can run in parallel. The first candidate of a batch that still
+	fails is kept, so the result does not depend on which run ends first.
+*/
+
+typedef enum {
+	tmin_lines,
+	tmin_literals,
+	tmin_bytes,
+	tmin_level_end,
+} tmin_level;
+
+// Index of the first candidate that still fails the same way, or SIZE_MAX
+// if none does
+typedef std::function<size_t(const std::vector<std::string> &candidates)> tmin_test;
+
+// Called with the size left after each level
+typedef std::function<void(tmin_level level, size_t size)> tmin_progress;
+
+// The smallest input found, testing up to batch candidates at a time
+std::string tmin_minimize(const std::string &input, size_t batch, tmin_test test, tmin_progress progress);
+
+#endif